@@ -0,0 +1,146 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "bench_utils.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Latency of lookups from coroutine handlers, awaiting
+ * either find() directly or async_find() through an
+ * interleaving_scheduler.
+ *
+ * The map holds a key range with memoized hashes, and every
+ * configuration looks up the same random keys, half of which
+ * are present. A number of handler coroutines share one thread
+ * and scheduler, each awaiting its share of the keys one after
+ * another, so up to that many lookups are in flight. A handler
+ * awaiting find() completes each lookup before the next starts;
+ * one awaiting async_find() yields after each prefetch, which
+ * overlaps the cache misses of the lookups in flight. Each
+ * configuration reports nanoseconds per lookup.
+ *
+ * Usage: async_bench [--keys 16777216] [--lookups 4000000]
+ *     [--inflight 1,8,32] [--mode find,async]
+ *
+ */
+#if CRH_HAS_COROUTINES
+namespace
+{
+    using key_type = std::uint64_t;
+    using reclaimer_policy = crh::reclamation::reclaimer<crh::reclamation::epoch_reclaimer>;
+
+    using map_type = crh::concurrent_robin_map<key_type, key_type, crh::hash::hash<key_type>,
+        std::allocator<std::pair<const key_type, key_type>>, reclaimer_policy, crh::reclamation::memoize_hash<true>>;
+
+    crh::async::detached find_handler(map_type& map, const key_type* first, const key_type* last, std::size_t& found)
+    {
+        for (; first != last; ++first)
+        {
+            key_type value;
+            if (map.find(*first, value, 0)) ++found;
+        }
+        co_return;
+    }
+
+    crh::async::detached async_handler(map_type& map, crh::async::interleaving_scheduler& scheduler,
+        const key_type* first, const key_type* last, std::size_t& found)
+    {
+        for (; first != last; ++first)
+        {
+            const std::optional<key_type> value = co_await map.async_find(*first, 0, scheduler);
+            if (value) ++found;
+        }
+    }
+
+    void run(map_type& map, const std::vector<key_type>& keys, const std::string& mode, const unsigned inflight, const std::size_t range)
+    {
+        crh::async::interleaving_scheduler scheduler;
+        std::size_t found = 0;
+
+        const auto begin = std::chrono::steady_clock::now();
+        for (unsigned h = 0; h < inflight; ++h)
+        {
+            const key_type* first = keys.data() + keys.size() * h / inflight;
+            const key_type* last = keys.data() + keys.size() * (h + 1) / inflight;
+
+            if (mode == "find") find_handler(map, first, last, found);
+            else async_handler(map, scheduler, first, last, found);
+        }
+        scheduler.run();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::printf("%-6s %9u %10zu %10zu %8.3f %10.1f\n", mode.c_str(), inflight, range, keys.size(),
+            keys.empty() ? 0.0 : static_cast<double>(found) / keys.size(), keys.empty() ? 0.0 : seconds * 1e9 / keys.size());
+        std::fflush(stdout);
+    }
+
+    key_type spread(const std::uint64_t i) noexcept { return i * 0x9e3779b97f4a7c15ull; }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t range = std::size_t(1) << 24, lookups = 4000000;
+    std::vector<unsigned> inflights = {1, 8, 32};
+    std::vector<std::string> modes = {"find", "async"};
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char* value = argv[i + 1];
+
+        if (!std::strcmp(argv[i], "--keys"))
+            range = std::stoul(value);
+        else if (!std::strcmp(argv[i], "--lookups"))
+            lookups = std::stoul(value);
+        else if (!std::strcmp(argv[i], "--inflight"))
+            inflights = crh::bench::parse_list<unsigned>(value, [](const std::string& s) { return static_cast<unsigned>(std::stoul(s)); });
+        else if (!std::strcmp(argv[i], "--mode"))
+            modes = crh::bench::parse_list<std::string>(value, [](const std::string& s) { return s; });
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (const std::string& mode : modes)
+    {
+        if (mode != "find" && mode != "async")
+        {
+            std::fprintf(stderr, "unknown mode %s\n", mode.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    map_type map(range, 1);
+    for (std::uint64_t i = 0; i < range; ++i) map.insert({spread(i), i}, 0);
+
+    // Keys drawn from twice the range, so about half of the lookups hit
+    std::vector<key_type> keys(lookups);
+    std::uint64_t x = 88172645463325252ull;
+    for (key_type& key : keys)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        key = spread(x % (2 * range));
+    }
+
+    std::printf("%-6s %9s %10s %10s %8s %10s\n", "mode", "inflight", "keys", "lookups", "hits", "ns/lookup");
+
+    for (const unsigned inflight : inflights)
+        for (const std::string& mode : modes)
+            run(map, keys, mode, std::max(inflight, 1u), range);
+
+    return EXIT_SUCCESS;
+}
+#else
+int main()
+{
+    std::fprintf(stderr, "async_bench needs a compiler with coroutine support\n");
+    return EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef CRH_BENCH_UTILS_HPP
+#define CRH_BENCH_UTILS_HPP
+
+#include "harness.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace crh
+{
+namespace bench
+{
+    /**
+     * @brief Splits a comma separated option value and parses
+     * every non-empty item
+     *
+     */
+    template< class T, class Parse >
+    std::vector<T> parse_list(const char* arg, Parse parse)
+    {
+        std::vector<T> values;
+        std::string list(arg);
+
+        for (std::size_t first = 0; first <= list.size();)
+        {
+            std::size_t last = list.find(',', first);
+            if (last == std::string::npos) last = list.size();
+
+            if (last != first) values.push_back(parse(list.substr(first, last - first)));
+            first = last + 1;
+        }
+        return values;
+    }
+
+    /**
+     * @brief The sample below which a share p of the samples
+     * fall. Reorders the samples
+     *
+     */
+    inline
+    std::uint32_t percentile(std::vector<std::uint32_t>& samples, const double p)
+    {
+        if (samples.empty()) return 0;
+
+        const std::size_t index = std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+} // namespace bench
+} // namespace crh
+
+#endif // !CRH_BENCH_UTILS_HPP
@@ -0,0 +1,146 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "crh/detail/kcas/harris_kcas.hpp"
+#include "replay.hpp"
+#include "bench_utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Replays a trace written by crh::trace::ring_recorder
+ * against a few preset map configurations, each a thin
+ * instantiation of crh::trace::replay, which replays against any
+ * map keyed by 64 bit words.
+ *
+ * Every traced thread gets a replay thread of its own that runs
+ * the thread's events in order. In timed mode each event waits
+ * until its original offset from the start of the trace, which
+ * keeps the interleaving and the bursts of the capture; in fast
+ * mode the threads run as fast as they can. Keys are replayed as
+ * the 64 bit words the trace holds, either the key itself or its
+ * hash. Before the replay the map is filled with every key whose
+ * first traced operation shows it was already present: a lookup
+ * or erase that succeeded, or an insert that failed.
+ *
+ * Each run reports operations per second, the share of events
+ * whose outcome differed from the trace, latency percentiles of
+ * single operations and, in timed mode, how far the replay fell
+ * behind the schedule at worst.
+ *
+ * Usage: crh_replay trace [--mode timed,fast]
+ *     [--map default,acq_rel,memoize,bounded,harris]
+ *
+ */
+namespace
+{
+    using key_type = std::uint64_t;
+    using allocator_type = std::allocator<std::pair<const key_type, key_type>>;
+    using reclaimer_policy = crh::reclamation::reclaimer<crh::reclamation::epoch_reclaimer>;
+
+    template< class... Policies >
+    using map_type = crh::concurrent_robin_map<key_type, key_type, crh::hash::hash<key_type>,
+        allocator_type, reclaimer_policy, Policies...>;
+
+    using harris_policy = crh::reclamation::kcas<crh::harris_kcas<allocator_type, crh::reclamation::epoch_reclaimer>>;
+
+    struct config
+    {
+        std::string _map;
+        bool _timed;
+    };
+
+    template< class Map >
+    void run(const crh::trace::schedule& s, const config& c)
+    {
+        const unsigned threads = static_cast<unsigned>(std::max<std::size_t>(s._threads.size(), 1));
+
+        Map map(static_cast<unsigned>(std::max<std::size_t>(s._keys, 16)), threads);
+        crh::trace::replay_result result = crh::trace::replay(map, s, c._timed);
+
+        std::printf("%-6s %-8s %8u %10zu %14.0f %9.4f %9u %9u %9u %10.3f\n",
+            c._timed ? "timed" : "fast", c._map.c_str(), threads, s._events,
+            s._events / result._seconds,
+            s._events ? static_cast<double>(result._mismatches) / s._events : 0.0,
+            crh::bench::percentile(result._latencies, 0.5), crh::bench::percentile(result._latencies, 0.99),
+            crh::bench::percentile(result._latencies, 0.999),
+            c._timed ? result._max_lag / 1e6 : 0.0);
+        std::fflush(stdout);
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        std::fprintf(stderr, "usage: crh_replay trace [--mode timed,fast] [--map default,acq_rel,memoize,bounded,harris]\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> modes = {"timed", "fast"};
+    std::vector<std::string> maps = {"default", "acq_rel", "memoize", "bounded", "harris"};
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        const char* value = argv[i + 1];
+
+        if (!std::strcmp(argv[i], "--mode"))
+            modes = crh::bench::parse_list<std::string>(value, [](const std::string& s) { return s; });
+        else if (!std::strcmp(argv[i], "--map"))
+            maps = crh::bench::parse_list<std::string>(value, [](const std::string& s) { return s; });
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<crh::trace::event> events;
+    if (!crh::trace::load(argv[1], events))
+    {
+        std::fprintf(stderr, "cannot read trace %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    const crh::trace::schedule s = crh::trace::make_schedule(events);
+    std::printf("%zu events, %zu threads, %zu keys, %zu preloaded\n",
+        s._events, s._threads.size(), s._keys, s._preload.size());
+
+    std::printf("%-6s %-8s %8s %10s %14s %9s %9s %9s %9s %10s\n",
+        "mode", "map", "threads", "events", "ops/s", "mismatch", "p50_ns", "p99_ns", "p999_ns", "max_lag_ms");
+
+    for (const std::string& mode : modes)
+    {
+        if (mode != "timed" && mode != "fast")
+        {
+            std::fprintf(stderr, "unknown mode %s\n", mode.c_str());
+            return EXIT_FAILURE;
+        }
+
+        for (const std::string& map : maps)
+        {
+            const config c{map, mode == "timed"};
+
+            if (map == "default")
+                run<map_type<>>(s, c);
+            else if (map == "acq_rel")
+                run<map_type<crh::reclamation::ordering<crh::ordering::acquire_release>>>(s, c);
+            else if (map == "memoize")
+                run<map_type<crh::reclamation::memoize_hash<true>>>(s, c);
+            else if (map == "bounded")
+                run<map_type<crh::reclamation::max_displacement<16>>>(s, c);
+            else if (map == "harris")
+                run<map_type<harris_policy>>(s, c);
+            else
+            {
+                std::fprintf(stderr, "unknown map %s\n", map.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef CRH_HARNESS_HPP
+#define CRH_HARNESS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace crh
+{
+namespace bench
+{
+    /**
+     * @brief Nanoseconds between two time points, saturated
+     * to fit a latency sample
+     *
+     */
+    inline
+    std::uint32_t latency_ns(const std::chrono::steady_clock::time_point& first,
+        const std::chrono::steady_clock::time_point& last) noexcept
+    {
+        return static_cast<std::uint32_t>(
+            std::min<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(last - first).count(), UINT32_MAX));
+    }
+
+    /**
+     * @brief Start line shared by the threads of a run. Begin
+     * is set before the threads are released
+     *
+     */
+    struct run_flags
+    {
+        std::atomic<bool> _start{false}, _stop{false};
+        std::chrono::steady_clock::time_point _begin;
+
+        void wait_for_start() const noexcept
+        {
+            while (!this->_start.load()) {}
+        }
+
+        bool stopped() const noexcept { return this->_stop.load(std::memory_order_relaxed); }
+    };
+
+    /**
+     * @brief Runs work(thread_id, flags) on threads of their
+     * own, releasing them together once they have had time to
+     * reach the start line. With a duration the run is stopped
+     * after it; otherwise it ends as every thread returns
+     *
+     * @return Seconds from the release to the last thread
+     * finishing
+     */
+    template< class Work >
+    double run_threads(const unsigned& threads, const unsigned& ms, Work&& work)
+    {
+        run_flags flags;
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+            workers.emplace_back([&work, &flags, t] { work(t, static_cast<const run_flags&>(flags)); });
+
+        // Leave the threads time to reach the start line, so none begins late
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        flags._begin = std::chrono::steady_clock::now();
+        flags._start.store(true);
+
+        if (ms != 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+            flags._stop.store(true);
+        }
+
+        for (std::thread& worker : workers) worker.join();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - flags._begin).count();
+    }
+} // namespace bench
+} // namespace crh
+
+#endif // !CRH_HARNESS_HPP
@@ -0,0 +1,178 @@
+#include "crh/util/utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Distribution quality and throughput harness for
+ * the default hashers.
+ *
+ * For each key set the hashes are inserted into a simulated
+ * Robin Hood table of the map's maximum load factor, with
+ * buckets picked by modulo as the map does by default, and the
+ * mean and maximum displacement are reported together with the
+ * share of entries displaced past the widest single kCAS.
+ * Throughput is reported per hash and, for byte keys, in GB/s.
+ *
+ * Usage: hash_bench [keys]
+ *
+ */
+namespace
+{
+    constexpr std::size_t S_KCAS_WIDTH = 128;
+    constexpr double S_MAX_LOAD = 0.75;
+
+    struct alignas(64) object
+    {
+        char _payload[64];
+    };
+
+    struct displacement
+    {
+        double _mean;
+        std::size_t _max, _beyond_kcas;
+    };
+
+    displacement robin_hood(const std::vector<std::size_t>& hashes)
+    {
+        std::size_t size = 1;
+        while (size * S_MAX_LOAD < hashes.size()) size <<= 1;
+
+        const std::size_t mask = size - 1;
+        std::vector<std::size_t> homes(size, SIZE_MAX);
+
+        for (std::size_t hash : hashes)
+        {
+            std::size_t home = hash % size, index = home;
+
+            for (std::size_t dist = 0;; ++dist, index = (index + 1) & mask)
+            {
+                if (homes[index] == SIZE_MAX)
+                {
+                    homes[index] = home;
+                    break;
+                }
+
+                const std::size_t other = (index - homes[index]) & mask;
+                if (other < dist)
+                {
+                    std::swap(home, homes[index]);
+                    dist = other;
+                }
+            }
+        }
+
+        displacement result{0.0, 0, 0};
+        for (std::size_t index = 0; index < size; ++index)
+        {
+            if (homes[index] == SIZE_MAX) continue;
+
+            const std::size_t dist = (index - homes[index]) & mask;
+            result._mean += dist;
+            result._max = std::max(result._max, dist);
+            result._beyond_kcas += dist >= S_KCAS_WIDTH;
+        }
+        result._mean /= hashes.size();
+        return result;
+    }
+
+    template< class Key, class Hash >
+    void quality(const char* keys_name, const char* hash_name, const std::vector<Key>& keys, const Hash& hash)
+    {
+        std::vector<std::size_t> hashes;
+        hashes.reserve(keys.size());
+        for (const Key& key : keys) hashes.push_back(hash(key));
+
+        const displacement d = robin_hood(hashes);
+        std::printf("%-14s %-10s %10.3f %10zu %12zu\n", keys_name, hash_name, d._mean, d._max, d._beyond_kcas);
+    }
+
+    template< class Key, class Hash >
+    double nanoseconds_per_hash(const std::vector<Key>& keys, const Hash& hash)
+    {
+        std::size_t sink = 0, rounds = 0;
+
+        const auto begin = std::chrono::steady_clock::now();
+        auto end = begin;
+        do
+        {
+            for (const Key& key : keys) sink += hash(key);
+            ++rounds;
+            end = std::chrono::steady_clock::now();
+        } while (end - begin < std::chrono::milliseconds(200));
+
+        volatile std::size_t keep = sink;
+        static_cast<void>(keep);
+
+        return std::chrono::duration<double, std::nano>(end - begin).count() / (rounds * keys.size());
+    }
+
+    std::vector<std::string> random_strings(const std::size_t& count, const std::size_t& length, std::mt19937_64& rng)
+    {
+        std::vector<std::string> strings(count, std::string(length, '\0'));
+        for (std::string& s : strings)
+            for (char& c : s) c = static_cast<char>('a' + rng() % 26);
+        return strings;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t count = argc > 1 ? std::stoul(argv[1]) : std::size_t(1) << 20;
+
+    std::mt19937_64 rng(42);
+
+    std::vector<std::uint64_t> sequential(count), strided(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        sequential[i] = i;
+        strided[i] = i << 12;
+    }
+
+    std::vector<object> objects(count);
+    std::vector<object*> pointers(count);
+    for (std::size_t i = 0; i < count; ++i) pointers[i] = &objects[i];
+
+    std::vector<std::string> ids(count);
+    for (std::size_t i = 0; i < count; ++i) ids[i] = "user:" + std::to_string(i);
+
+    const crh::hash::hash<std::uint64_t> int_hash;
+    const crh::hash::hash<object*> pointer_hash;
+    const crh::hash::hash<std::string> string_hash;
+
+    std::printf("%-14s %-10s %10s %10s %12s\n", "keys", "hash", "mean_disp", "max_disp", "disp>=kcas");
+    quality("sequential", "crh", sequential, int_hash);
+    quality("sequential", "std", sequential, std::hash<std::uint64_t>());
+    quality("strided", "crh", strided, int_hash);
+    quality("strided", "std", strided, std::hash<std::uint64_t>());
+    quality("pointers", "crh", pointers, pointer_hash);
+    quality("pointers", "std", pointers, std::hash<object*>());
+    quality("string_ids", "crh", ids, string_hash);
+    quality("string_ids", "std", ids, std::hash<std::string>());
+
+    std::printf("\n%-14s %-10s %10s %10s\n", "keys", "hash", "ns/hash", "GB/s");
+    std::printf("%-14s %-10s %10.2f %10s\n", "uint64", "crh", nanoseconds_per_hash(sequential, int_hash), "-");
+    std::printf("%-14s %-10s %10.2f %10s\n", "uint64", "std", nanoseconds_per_hash(sequential, std::hash<std::uint64_t>()), "-");
+    std::printf("%-14s %-10s %10.2f %10s\n", "pointer", "crh", nanoseconds_per_hash(pointers, pointer_hash), "-");
+
+    for (const std::size_t length : {8, 16, 32, 64, 256, 1024, 4096})
+    {
+        const std::vector<std::string> strings = random_strings(std::max<std::size_t>(count / length, 64), length, rng);
+        const std::string name = "bytes[" + std::to_string(length) + "]";
+
+        for (const bool ours : {true, false})
+        {
+            const double ns = ours ? nanoseconds_per_hash(strings, string_hash)
+                                   : nanoseconds_per_hash(strings, std::hash<std::string>());
+            std::printf("%-14s %-10s %10.2f %10.2f\n", name.c_str(), ours ? "crh" : "std", ns, length / ns);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
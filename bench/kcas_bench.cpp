@@ -0,0 +1,298 @@
+#include "crh/detail/kcas/brown_kcas.hpp"
+#include "crh/detail/kcas/harris_kcas.hpp"
+#include "bench_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Contention harness for the kCAS implementations.
+ *
+ * Every thread repeatedly reads k words and swaps them all to
+ * their successors in one kCAS. The words of an operation are
+ * laid out according to the placement, and with the overlap
+ * probability they are drawn from a pool shared by every
+ * thread instead of a pool private to the thread. Same line
+ * placement spills into the following lines once k exceeds
+ * the words of one line, and such runs report their line
+ * count as the placement, as in 2_lines. Each
+ * configuration reports successful kCAS per second, the share
+ * of attempts that failed, helps of other threads' operations
+ * per successful kCAS, and latency percentiles of single
+ * attempts.
+ *
+ * Usage: kcas_bench [--k 2,4,8,16] [--threads 1,2,4]
+ *     [--placement same_line,adjacent,random]
+ *     [--overlap 0,0.1,1] [--ms 200] [--kcas brown,harris]
+ *
+ */
+namespace
+{
+    using reclaimer_type = crh::reclamation::epoch_reclaimer;
+    using word_type = std::uintptr_t;
+
+    constexpr std::size_t S_WORDS_PER_LINE = 64 / sizeof(std::atomic<word_type>);
+    constexpr std::size_t S_POOL_LINES = 4096;
+    constexpr std::size_t S_POOL_WORDS = S_POOL_LINES * S_WORDS_PER_LINE;
+    constexpr word_type S_INCREMENT = 0x4;
+
+    enum class placement
+    {
+        SAME_LINE,
+        ADJACENT,
+        RANDOM
+    };
+
+    struct config
+    {
+        std::string _kcas;
+        std::size_t _k;
+        unsigned _threads;
+        placement _placement;
+        double _overlap;
+        unsigned _ms;
+    };
+
+    struct alignas(128) thread_result
+    {
+        std::size_t _successes = 0, _failures = 0, _helps = 0;
+        std::vector<std::uint32_t> _latencies;
+    };
+
+    /**
+     * @brief Name of the placement a run actually got. Same line
+     * packs more words than a line holds into consecutive lines,
+     * and is reported as the number of lines
+     *
+     */
+    std::string placement_name(const config& c)
+    {
+        switch (c._placement)
+        {
+        case placement::SAME_LINE:
+        {
+            const std::size_t lines = (c._k + S_WORDS_PER_LINE - 1) / S_WORDS_PER_LINE;
+            return lines == 1 ? "same_line" : std::to_string(lines) + "_lines";
+        }
+        case placement::ADJACENT: return "adjacent";
+        default: return "random";
+        }
+    }
+
+    /**
+     * @brief Picks the words of one operation from a
+     * pool, distinct and in pool order
+     *
+     */
+    void pick_words(std::atomic<word_type>* pool, const config& c, std::mt19937_64& rng,
+        std::vector<std::atomic<word_type>*>& words)
+    {
+        words.clear();
+
+        switch (c._placement)
+        {
+        case placement::SAME_LINE:
+        {
+            const std::size_t lines = (c._k + S_WORDS_PER_LINE - 1) / S_WORDS_PER_LINE;
+            const std::size_t first = (rng() % (S_POOL_LINES - lines + 1)) * S_WORDS_PER_LINE;
+            for (std::size_t i = 0; i < c._k; ++i) words.push_back(pool + first + i);
+            break;
+        }
+        case placement::ADJACENT:
+        {
+            const std::size_t first = rng() % (S_POOL_LINES - c._k + 1);
+            for (std::size_t i = 0; i < c._k; ++i) words.push_back(pool + (first + i) * S_WORDS_PER_LINE);
+            break;
+        }
+        default:
+            while (words.size() < c._k)
+            {
+                std::atomic<word_type>* word = pool + rng() % S_POOL_WORDS;
+                if (std::find(words.begin(), words.end(), word) == words.end()) words.push_back(word);
+            }
+            break;
+        }
+    }
+
+    template< class KCAS >
+    void worker(KCAS& kcas, reclaimer_type& reclaimer, const config& c, const unsigned thread_id,
+        std::atomic<word_type>* shared_pool, std::atomic<word_type>* private_pool,
+        const crh::bench::run_flags& flags, thread_result& result)
+    {
+        using entry_type = typename KCAS::entry_type;
+
+        std::mt19937_64 rng(thread_id * 0x9e3779b97f4a7c15ull + 1);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+        std::vector<std::atomic<word_type>*> words;
+        std::vector<entry_type> entries(c._k);
+
+        result._latencies.reserve(1 << 20);
+
+        flags.wait_for_start();
+
+        while (!flags.stopped())
+        {
+            pick_words(coin(rng) < c._overlap ? shared_pool : private_pool, c, rng, words);
+
+            const auto begin = std::chrono::steady_clock::now();
+            {
+                crh::reclamation::reclaimer_pin<reclaimer_type> pin(reclaimer, thread_id);
+
+                for (std::size_t i = 0; i < c._k; ++i)
+                {
+                    const word_type value = kcas.read(*words[i]);
+                    entries[i] = entry_type{words[i], value, value + S_INCREMENT};
+                }
+
+                if (kcas.cas(thread_id, entries.data(), entries.data() + c._k)) ++result._successes;
+                else ++result._failures;
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            result._latencies.push_back(crh::bench::latency_ns(begin, end));
+        }
+
+#ifdef CRH_KCAS_STATS
+        result._helps = kcas.helps(thread_id);
+#endif
+    }
+
+    /**
+     * @brief A kCAS and its reclaimer, in the order the map
+     * keeps them: the reclaimer is declared after the kCAS so it
+     * is destroyed first, as releasing the descriptors it still
+     * holds calls back into the kCAS. The kCAS is handed the
+     * reclaimer before it is constructed, so it must only keep
+     * the reference and not use the reclaimer during construction
+     *
+     */
+    template< class KCAS >
+    struct kcas_with_reclaimer
+    {
+        KCAS _kcas;
+        reclaimer_type _reclaimer;
+
+        explicit
+        kcas_with_reclaimer(const unsigned& threads) :
+            _kcas(threads, _reclaimer),
+            _reclaimer(threads) {}
+    };
+
+    template< class KCAS >
+    void run(const config& c)
+    {
+        kcas_with_reclaimer<KCAS> harness(c._threads);
+        KCAS& kcas = harness._kcas;
+        reclaimer_type& reclaimer = harness._reclaimer;
+
+        // One shared pool followed by one private pool per thread
+        std::unique_ptr<std::atomic<word_type>[]> pools(
+            new std::atomic<word_type>[S_POOL_WORDS * (c._threads + 1)]());
+
+        std::vector<thread_result> results(c._threads);
+
+        const double seconds = crh::bench::run_threads(c._threads, c._ms,
+            [&](const unsigned t, const crh::bench::run_flags& flags)
+            {
+                worker(kcas, reclaimer, c, t, pools.get(), pools.get() + S_POOL_WORDS * (t + 1), flags, results[t]);
+            });
+
+        std::size_t successes = 0, failures = 0, helps = 0;
+        std::vector<std::uint32_t> latencies;
+        for (thread_result& result : results)
+        {
+            successes += result._successes;
+            failures += result._failures;
+            helps += result._helps;
+            latencies.insert(latencies.end(), result._latencies.begin(), result._latencies.end());
+        }
+
+        const std::size_t attempts = successes + failures;
+        std::printf("%-7s %3zu %8u %-10s %7.2f %14.0f %9.4f %9.4f %9u %9u %9u\n",
+            c._kcas.c_str(), c._k, c._threads, placement_name(c).c_str(), c._overlap,
+            successes / seconds,
+            attempts ? static_cast<double>(failures) / attempts : 0.0,
+            successes ? static_cast<double>(helps) / successes : 0.0,
+            crh::bench::percentile(latencies, 0.5), crh::bench::percentile(latencies, 0.99), crh::bench::percentile(latencies, 0.999));
+        std::fflush(stdout);
+    }
+
+    placement parse_placement(const std::string& name)
+    {
+        if (name == "same_line") return placement::SAME_LINE;
+        if (name == "adjacent") return placement::ADJACENT;
+        if (name == "random") return placement::RANDOM;
+
+        std::fprintf(stderr, "unknown placement %s\n", name.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<std::size_t> ks = {2, 4, 8, 16};
+    std::vector<unsigned> thread_counts = {1, 2, 4};
+    std::vector<placement> placements = {placement::SAME_LINE, placement::ADJACENT, placement::RANDOM};
+    std::vector<double> overlaps = {0.0, 0.1, 1.0};
+    std::vector<std::string> implementations = {"brown", "harris"};
+    unsigned ms = 200;
+
+    const unsigned hardware = std::thread::hardware_concurrency();
+    if (hardware > 4) thread_counts.push_back(hardware);
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char* value = argv[i + 1];
+
+        if (!std::strcmp(argv[i], "--k"))
+            ks = crh::bench::parse_list<std::size_t>(value, [](const std::string& s) { return std::stoul(s); });
+        else if (!std::strcmp(argv[i], "--threads"))
+            thread_counts = crh::bench::parse_list<unsigned>(value, [](const std::string& s) { return static_cast<unsigned>(std::stoul(s)); });
+        else if (!std::strcmp(argv[i], "--placement"))
+            placements = crh::bench::parse_list<placement>(value, parse_placement);
+        else if (!std::strcmp(argv[i], "--overlap"))
+            overlaps = crh::bench::parse_list<double>(value, [](const std::string& s) { return std::stod(s); });
+        else if (!std::strcmp(argv[i], "--kcas"))
+            implementations = crh::bench::parse_list<std::string>(value, [](const std::string& s) { return s; });
+        else if (!std::strcmp(argv[i], "--ms"))
+            ms = static_cast<unsigned>(std::stoul(value));
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::printf("%-7s %3s %8s %-10s %7s %14s %9s %9s %9s %9s %9s\n",
+        "kcas", "k", "threads", "placement", "overlap", "kcas/s", "fail", "help/op", "p50_ns", "p99_ns", "p999_ns");
+
+    for (const std::string& implementation : implementations)
+        for (const std::size_t k : ks)
+            for (const placement p : placements)
+                for (const unsigned threads : thread_counts)
+                    for (const double overlap : overlaps)
+                    {
+                        const config c{implementation, std::min<std::size_t>(k, 128), threads, p, overlap, ms};
+
+                        if (implementation == "brown")
+                            run<crh::brown_kcas<std::allocator<word_type>, reclaimer_type>>(c);
+                        else if (implementation == "harris")
+                            run<crh::harris_kcas<std::allocator<word_type>, reclaimer_type>>(c);
+                        else
+                        {
+                            std::fprintf(stderr, "unknown kcas %s\n", implementation.c_str());
+                            return EXIT_FAILURE;
+                        }
+                    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
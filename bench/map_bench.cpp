@@ -0,0 +1,153 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "bench_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Throughput harness for the map under each memory
+ * ordering policy.
+ *
+ * The map is filled with half of a key range, and every thread
+ * then runs a mix of lookups and updates over the whole range:
+ * lookups hit or miss about equally, and each update inserts a
+ * random key or erases it again, so the load stays put. Each
+ * configuration reports operations per second.
+ *
+ * Usage: map_bench [--threads 1,2,4] [--reads 100,90,50]
+ *     [--keys 1048576] [--ms 500] [--ordering seq_cst,acq_rel]
+ *
+ */
+namespace
+{
+    using reclaimer_policy = crh::reclamation::reclaimer<crh::reclamation::epoch_reclaimer>;
+
+    template< class Ordering >
+    using map_type = crh::concurrent_robin_map<std::uint64_t, std::uint64_t, crh::hash::hash<std::uint64_t>,
+        std::allocator<std::pair<const std::uint64_t, std::uint64_t>>, reclaimer_policy,
+        crh::reclamation::ordering<Ordering>>;
+
+    struct config
+    {
+        std::string _ordering;
+        unsigned _threads, _reads;
+        std::size_t _keys;
+        unsigned _ms;
+    };
+
+    struct alignas(128) thread_result
+    {
+        std::size_t _operations = 0;
+    };
+
+    template< class Map >
+    void worker(Map& map, const config& c, const unsigned thread_id,
+        const crh::bench::run_flags& flags, thread_result& result)
+    {
+        std::mt19937_64 rng(thread_id * 0x9e3779b97f4a7c15ull + 1);
+
+        flags.wait_for_start();
+
+        std::size_t operations = 0;
+        while (!flags.stopped())
+        {
+            // Poll the stop flag only every few operations
+            for (unsigned i = 0; i < 64; ++i, ++operations)
+            {
+                const std::uint64_t r = rng();
+                const std::uint64_t key = r % c._keys;
+
+                if ((r >> 32) % 100 < c._reads)
+                {
+                    map.contains(key, thread_id);
+                }
+                else if (!map.insert({key, key}, thread_id))
+                {
+                    map.erase(key, thread_id);
+                }
+            }
+        }
+        result._operations = operations;
+    }
+
+    template< class Ordering >
+    void run(const config& c)
+    {
+        map_type<Ordering> map(c._keys, c._threads);
+        for (std::uint64_t key = 0; key < c._keys; key += 2) map.insert({key, key}, 0);
+
+        std::vector<thread_result> results(c._threads);
+
+        const double seconds = crh::bench::run_threads(c._threads, c._ms,
+            [&](const unsigned t, const crh::bench::run_flags& flags) { worker(map, c, t, flags, results[t]); });
+
+        std::size_t operations = 0;
+        for (const thread_result& result : results) operations += result._operations;
+
+        std::printf("%-8s %8u %6u %10zu %14.0f\n",
+            c._ordering.c_str(), c._threads, c._reads, c._keys, operations / seconds);
+        std::fflush(stdout);
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<unsigned> thread_counts = {1, 2, 4};
+    std::vector<unsigned> reads = {100, 90, 50};
+    std::vector<std::string> orderings = {"seq_cst", "acq_rel"};
+    std::size_t keys = std::size_t(1) << 20;
+    unsigned ms = 500;
+
+    const unsigned hardware = std::thread::hardware_concurrency();
+    if (hardware > 4) thread_counts.push_back(hardware);
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char* value = argv[i + 1];
+
+        if (!std::strcmp(argv[i], "--threads"))
+            thread_counts = crh::bench::parse_list<unsigned>(value, [](const std::string& s) { return static_cast<unsigned>(std::stoul(s)); });
+        else if (!std::strcmp(argv[i], "--reads"))
+            reads = crh::bench::parse_list<unsigned>(value, [](const std::string& s) { return static_cast<unsigned>(std::stoul(s)); });
+        else if (!std::strcmp(argv[i], "--ordering"))
+            orderings = crh::bench::parse_list<std::string>(value, [](const std::string& s) { return s; });
+        else if (!std::strcmp(argv[i], "--keys"))
+            keys = std::stoul(value);
+        else if (!std::strcmp(argv[i], "--ms"))
+            ms = static_cast<unsigned>(std::stoul(value));
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::printf("%-8s %8s %6s %10s %14s\n", "ordering", "threads", "reads", "keys", "ops/s");
+
+    for (const unsigned threads : thread_counts)
+        for (const unsigned r : reads)
+            for (const std::string& ordering : orderings)
+            {
+                const config c{ordering, threads, std::min(r, 100u), keys, ms};
+
+                if (ordering == "seq_cst")
+                    run<crh::ordering::sequentially_consistent>(c);
+                else if (ordering == "acq_rel")
+                    run<crh::ordering::acquire_release>(c);
+                else
+                {
+                    std::fprintf(stderr, "unknown ordering %s\n", ordering.c_str());
+                    return EXIT_FAILURE;
+                }
+            }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#ifndef CRH_REPLAY_HPP
+#define CRH_REPLAY_HPP
+
+#include "crh/util/trace.hpp"
+#include "harness.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace crh
+{
+namespace trace
+{
+    /**
+     * @brief A loaded trace laid out for replay: the events of
+     * every traced thread in the order of their timestamps, and
+     * the keys that were present before the trace began
+     *
+     */
+    struct schedule
+    {
+        std::vector<std::vector<event>> _threads;
+        std::vector<std::uint64_t> _preload;
+        std::uint64_t _first_timestamp = 0;
+        std::size_t _events = 0, _keys = 0;
+    };
+
+    /**
+     * @brief What a replay measured. Latencies are those of
+     * single operations in nanoseconds, saturated to 32 bits,
+     * and the lag is how far a timed replay fell behind the
+     * schedule at worst
+     *
+     */
+    struct replay_result
+    {
+        double _seconds = 0;
+        std::size_t _mismatches = 0;
+        std::uint64_t _max_lag = 0;
+        std::vector<std::uint32_t> _latencies;
+    };
+
+    /**
+     * @brief Lays out loaded events for replay. A key counts as
+     * present before the trace if its first traced operation was
+     * a lookup or erase that succeeded, or an insert that failed.
+     * Sorts the events
+     *
+     */
+    inline
+    schedule make_schedule(std::vector<event>& events)
+    {
+        schedule s;
+        s._events = events.size();
+
+        std::stable_sort(events.begin(), events.end(), [](const event& a, const event& b)
+        {
+            return a._timestamp < b._timestamp;
+        });
+
+        if (!events.empty()) s._first_timestamp = events.front()._timestamp;
+
+        std::unordered_map<std::uint32_t, std::size_t> threads;
+        std::unordered_map<std::uint64_t, bool> present;
+
+        for (const event& e : events)
+        {
+            auto thread = threads.emplace(e._thread_id, threads.size()).first;
+            if (thread->second == s._threads.size()) s._threads.emplace_back();
+            s._threads[thread->second].push_back(e);
+
+            const bool succeeded = e._flags & S_SUCCEEDED;
+            const bool existed = e._op == op::INSERT ? !succeeded : succeeded;
+            if (present.emplace(e._key, existed).second && existed) s._preload.push_back(e._key);
+        }
+
+        s._keys = present.size();
+        return s;
+    }
+
+    /**
+     * @brief Runs one event against a map keyed by the 64 bit
+     * words of the trace, mapping every key to itself
+     *
+     * @return Whether the operation succeeded
+     */
+    template< class Map >
+    bool apply(Map& map, const event& e, const unsigned& thread_id)
+    {
+        switch (e._op)
+        {
+        case op::INSERT: return map.insert({e._key, e._key}, thread_id);
+        case op::ERASE: return map.erase(e._key, thread_id);
+        default: return map.contains(e._key, thread_id);
+        }
+    }
+
+    /**
+     * @brief Replays a schedule against a map, which must take
+     * as many thread ids as the schedule has threads. The map is
+     * filled with the preloaded keys from thread id 0 first.
+     * Every traced thread gets a replay thread of its own that
+     * runs its events in order; a timed replay holds each event
+     * back until its original offset from the start of the
+     * trace, while an untimed one runs as fast as it can
+     *
+     */
+    template< class Map >
+    replay_result replay(Map& map, const schedule& s, const bool& timed)
+    {
+        for (const std::uint64_t key : s._preload) map.insert({key, key}, 0);
+
+        struct alignas(128) thread_result
+        {
+            std::size_t _mismatches = 0;
+            std::uint64_t _max_lag = 0;
+            std::vector<std::uint32_t> _latencies;
+        };
+
+        std::vector<thread_result> results(s._threads.size());
+
+        const double seconds = bench::run_threads(static_cast<unsigned>(s._threads.size()), 0,
+            [&](const unsigned t, const bench::run_flags& flags)
+            {
+                thread_result& result = results[t];
+                result._latencies.reserve(s._threads[t].size());
+
+                flags.wait_for_start();
+
+                for (const event& e : s._threads[t])
+                {
+                    if (timed)
+                    {
+                        const auto due = flags._begin + std::chrono::nanoseconds(e._timestamp - s._first_timestamp);
+                        while (std::chrono::steady_clock::now() < due) std::this_thread::yield();
+
+                        result._max_lag = std::max<std::uint64_t>(result._max_lag,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - due).count());
+                    }
+
+                    const auto first = std::chrono::steady_clock::now();
+                    const bool succeeded = apply(map, e, t);
+                    result._latencies.push_back(bench::latency_ns(first, std::chrono::steady_clock::now()));
+
+                    if (succeeded != bool(e._flags & S_SUCCEEDED)) ++result._mismatches;
+                }
+            });
+
+        replay_result replayed;
+        replayed._seconds = seconds;
+
+        for (thread_result& result : results)
+        {
+            replayed._mismatches += result._mismatches;
+            replayed._max_lag = std::max(replayed._max_lag, result._max_lag);
+            replayed._latencies.insert(replayed._latencies.end(), result._latencies.begin(), result._latencies.end());
+        }
+        return replayed;
+    }
+} // namespace trace
+} // namespace crh
+
+#endif // !CRH_REPLAY_HPP
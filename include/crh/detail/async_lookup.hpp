@@ -0,0 +1,200 @@
+#ifndef CRH_ASYNC_LOOKUP_HPP
+#define CRH_ASYNC_LOOKUP_HPP
+
+#if __cpp_impl_coroutine && __has_include(<coroutine>)
+#define CRH_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace crh
+{
+namespace async
+{
+    /**
+     * @brief Round robin scheduler for lookups that have
+     * issued a prefetch. A suspended lookup is resumed only
+     * after every lookup queued before it has run, which gives
+     * its cache line the time of those steps to arrive.
+     *
+     * One scheduler belongs to one thread; it is not safe to
+     * share across threads. The owning event loop calls run()
+     * or run_one() to drive the queued lookups.
+     *
+     */
+    class interleaving_scheduler
+    {
+    private:
+        std::deque<std::coroutine_handle<>> _ready;
+
+    public:
+        class yield_awaiter
+        {
+        private:
+            interleaving_scheduler& _scheduler;
+
+        public:
+            explicit
+            yield_awaiter(interleaving_scheduler& scheduler) : _scheduler(scheduler) {}
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle) { this->_scheduler._ready.push_back(handle); }
+
+            void await_resume() const noexcept {}
+        };
+
+        interleaving_scheduler() = default;
+        interleaving_scheduler(const interleaving_scheduler&) = delete;
+        interleaving_scheduler &operator=(const interleaving_scheduler&) = delete;
+
+        /**
+         * @brief Suspends the calling coroutine behind every
+         * coroutine already queued
+         *
+         */
+        yield_awaiter yield() noexcept { return yield_awaiter(*this); }
+
+        bool empty() const noexcept { return this->_ready.empty(); }
+
+        std::size_t pending() const noexcept { return this->_ready.size(); }
+
+        /**
+         * @brief Resumes the oldest queued coroutine
+         *
+         * @return false if nothing was queued
+         */
+        bool run_one()
+        {
+            if (this->_ready.empty()) return false;
+
+            std::coroutine_handle<> handle = this->_ready.front();
+            this->_ready.pop_front();
+            handle.resume();
+
+            return true;
+        }
+
+        void run()
+        {
+            while (this->run_one()) {}
+        }
+    };
+
+    /**
+     * @brief Lazily started lookup. Awaiting it starts the
+     * lookup, and the awaiting coroutine is resumed with the
+     * result once the lookup completes
+     *
+     * @tparam T The result type
+     */
+    template< class T >
+    class lookup_task
+    {
+    public:
+        class promise_type
+        {
+        private:
+            std::optional<T> _value;
+
+            std::exception_ptr _exception;
+
+            std::coroutine_handle<> _continuation = std::noop_coroutine();
+
+            friend class lookup_task;
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    return handle.promise()._continuation;
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+        public:
+            lookup_task get_return_object() noexcept
+            {
+                return lookup_task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+
+            final_awaiter final_suspend() const noexcept { return {}; }
+
+            template< class U >
+            void return_value(U&& value) { this->_value.emplace(std::forward<U>(value)); }
+
+            void unhandled_exception() noexcept { this->_exception = std::current_exception(); }
+        };
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+
+        explicit
+        lookup_task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+    public:
+        lookup_task(lookup_task&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+        lookup_task(const lookup_task&) = delete;
+        lookup_task &operator=(const lookup_task&) = delete;
+        lookup_task &operator=(lookup_task&&) = delete;
+
+        ~lookup_task()
+        {
+            if (this->_handle) this->_handle.destroy();
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            this->_handle.promise()._continuation = awaiting;
+            return this->_handle;
+        }
+
+        T await_resume()
+        {
+            promise_type& promise = this->_handle.promise();
+
+            if (promise._exception) std::rethrow_exception(promise._exception);
+
+            return std::move(*promise._value);
+        }
+    };
+
+    /**
+     * @brief A coroutine started eagerly and never awaited,
+     * which frees itself once it returns. Event loops use it to
+     * start the lookups they hand to a scheduler; an exception
+     * escaping it terminates
+     *
+     */
+    struct detached
+    {
+        struct promise_type
+        {
+            detached get_return_object() const noexcept { return {}; }
+
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+
+            std::suspend_never final_suspend() const noexcept { return {}; }
+
+            void return_void() const noexcept {}
+
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+    };
+} // namespace async
+} // namespace crh
+
+#endif // __cpp_impl_coroutine
+
+#endif // !CRH_ASYNC_LOOKUP_HPP
\ No newline at end of file
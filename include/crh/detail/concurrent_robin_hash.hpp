@@ -3,6 +3,10 @@
 
 #include "precomp.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 namespace crh
 {
     template< typename T >
@@ -12,22 +16,1891 @@ namespace crh
     };
 
     /**
-     * @brief 
-     * 
-     * @tparam T 
-     * @tparam void 
+     * @brief
+     *
+     * @tparam T
+     * @tparam void
      */
     template< typename T, typename = void >
     struct has_is_transparent : public constraints::is_set<constraints::unit> {};
 
     /**
-     * @brief 
-     * 
-     * @tparam T 
+     * @brief
+     *
+     * @tparam T
      */
     template< typename T >
-    struct has_is_transparent<T, typename make_void<typename T::is_transparent>::type> : 
+    struct has_is_transparent<T, typename make_void<typename T::is_transparent>::type> :
         public constraints::is_set<T> {};
+
+    /**
+     * @brief An entry of the table. Buckets hold a
+     * pointer to their entry, so entries are aligned
+     * to leave the low bits of that pointer free for
+     * kCAS tags and the migration mark
+     *
+     * @tparam ValueType
+     * @tparam StoreHash Flag representing
+     * storage state of hash
+     */
+    template< class ValueType, bool StoreHash >
+    class alignas(8) bucket_entry : public hash::bucket_entry_hash<StoreHash>
+    {
+    private:
+        ValueType _value;
+
+    public:
+        template< typename... Args >
+        explicit
+        bucket_entry(Args&&... args) : _value(std::forward<Args>(args)...) {}
+
+        using hash::bucket_entry_hash<StoreHash>::set_hash;
+
+        ValueType& value() noexcept { return this->_value; }
+        const ValueType& value() const noexcept { return this->_value; }
+    };
+
+    /**
+     * @brief Concurrent robin hood hash table as presented
+     * by Kelley, Pearlmutter and Maguire. Insertions and
+     * erasures publish every shifted bucket together with the
+     * timestamps of the regions they touch in a single kCAS;
+     * lookups validate the timestamps of the regions they
+     * scanned before reporting a miss.
+     *
+     * The table grows by cooperative migration: buckets of the
+     * old array are frozen one at a time and their entries are
+     * re-inserted into the new array by whichever threads are
+     * helping. The same migration shrinks the table once its load
+     * falls below MinLoad percent, so the smaller array is again
+     * built by Robin Hood insertion; it never shrinks below the
+     * array it was constructed with. A non-zero Buckets fixes the
+     * capacity at compile time instead; the array is then stored
+     * inline, every resize path is compiled out, and inserts fail
+     * once five eighths of the buckets are taken or promised to
+     * inserts in flight, so concurrent inserts never fill more.
+     *
+     * A non-zero MaxDisplacement caps the distance of every entry
+     * from its home bucket, and with it the probe of a lookup. It
+     * caps the buckets an insertion swaps, and those each step of a
+     * backward shift moves, as well, so no kCAS grows with the
+     * clusters. The entry an insertion would carry past either cap
+     * goes into a small overflow stash of the table instead, in the
+     * same kCAS; lookups that miss consult the stash only while its
+     * count is non-zero. Once the stash is half full the table grows
+     * early, and the stash migrates with the buckets, so every new
+     * table takes back whatever stashed entries now fit.
+     *
+     * @tparam ValueType
+     * @tparam KeySelect
+     * @tparam ValueSelect
+     * @tparam Hash
+     * @tparam KeyEqual
+     * @tparam Allocator
+     * @tparam StoreHash Flag representing
+     * storage state of hash
+     * @tparam KCAS A kCAS policy
+     * @tparam MemReclaimer A memory reclaimer policy
+     * @tparam Backoff A backoff policy
+     * @tparam MapToBucket
+     * @tparam Buckets Fixed bucket count, or zero
+     * for a table that grows
+     * @tparam MinLoad Load in percent below which the
+     * table shrinks, or zero to never shrink
+     * @tparam Ordering A memory ordering policy
+     * @tparam MaxDisplacement Largest distance of an entry
+     * from its home bucket, or zero for no cap
+     */
+    template< class ValueType,
+              class KeySelect,
+              class ValueSelect,
+              class Hash,
+              class KeyEqual,
+              class Allocator,
+              bool StoreHash,
+              class KCAS,
+              class MemReclaimer,
+              class Backoff,
+              class MapToBucket,
+              std::size_t Buckets = 0,
+              std::size_t MinLoad = 0,
+              class Ordering = ordering::sequentially_consistent,
+              std::size_t MaxDisplacement = 0 >
+    class concurrent_robin_hash
+    {
+    public:
+        using value_type = ValueType;
+        using hash_type = hash::hash_type;
+        using word_type = typename KCAS::state_type;
+        using entry_type = bucket_entry<value_type, StoreHash>;
+        using kcas_entry_type = typename KCAS::entry_type;
+        using record_handle = typename MemReclaimer::record_handle;
+        using entry_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<entry_type>;
+
+        static constexpr word_type S_EMPTY = 0x0, S_MOVED = 0x4;
+        static constexpr word_type S_TIMESTAMP_INCREMENT = 0x8;
+        static constexpr std::size_t S_MAX_ENTRIES = KCAS::S_MAX_ENTRIES;
+        static constexpr std::size_t S_MIGRATION_CHUNK = 1024;
+        static constexpr std::size_t S_MIN_BUCKETS = 16;
+        static constexpr unsigned S_TIMESTAMP_SHIFT = 5;
+        static constexpr unsigned S_LOAD_CHECK_INTERVAL = 64;
+        static constexpr unsigned S_PREFETCH_DISTANCE = 4;
+        static constexpr unsigned S_MAX_LOAD_NUMERATOR = 3, S_MAX_LOAD_DENOMINATOR = 4;
+        static constexpr bool S_FIXED = Buckets != 0;
+        static constexpr bool S_BOUNDED = MaxDisplacement != 0;
+        static constexpr std::size_t S_STASH_SIZE = 64;
+        static constexpr unsigned S_BUCKET_COUNT_SHIFT = 6;
+        static constexpr word_type S_STASH_COUNT_INCREMENT = 0x8;
+
+        // An overflow grows the table at most this many doublings past the size its load calls for
+        static constexpr unsigned S_MAX_OVERFLOW_DOUBLINGS = 3;
+
+        // The stash slot and its count join an insertion's kCAS, and the stash migrates as one more chunk
+        static constexpr std::size_t S_STASH_WORDS = S_BOUNDED ? 2 : 0, S_STASH_CHUNKS = S_BOUNDED ? 1 : 0;
+
+        // A fixed table stops taking entries well before an insertion's chain outgrows a kCAS
+        static constexpr unsigned S_FIXED_LOAD_NUMERATOR = 5, S_FIXED_LOAD_DENOMINATOR = 8;
+        static constexpr std::size_t S_FIXED_CAPACITY = Buckets * S_FIXED_LOAD_NUMERATOR / S_FIXED_LOAD_DENOMINATOR;
+
+        static_assert((KCAS::S_RESERVED_BITS & S_MOVED) == 0, "kCAS tag bits overlap the migration mark.");
+        static_assert(alignof(entry_type) > S_MOVED, "entries must leave the migration mark free.");
+        static_assert((Buckets & (Buckets - 1)) == 0, "fixed bucket count must be a power of two.");
+        static_assert(MinLoad * S_MAX_LOAD_DENOMINATOR * 2 < S_MAX_LOAD_NUMERATOR * 100,
+            "minimum load must stay below half the maximum load, or shrinking and growing alternate.");
+        static_assert(MaxDisplacement < S_MAX_ENTRIES / 2, "displacement cap must leave room for the timestamps in a kCAS.");
+
+        /**
+         * @brief Position of a weakly consistent scan. Entries are
+         * reported with the region holding their home bucket, so
+         * moving an entry within its cluster never makes a scan
+         * miss or repeat it. Every resize met by the scan adds a
+         * level; an entry is reported at a level only if its home
+         * region was not yet covered at any earlier level. Stashed
+         * entries are reported with their home region as well.
+         *
+         */
+        class scan_cursor
+        {
+        private:
+            using region_range = std::pair<std::size_t, std::size_t>;
+
+            struct level
+            {
+                std::size_t _size, _generation;
+
+                // Home regions to scan, and the next one
+                std::vector<region_range> _ranges;
+                std::size_t _range, _region;
+
+                bool covered(const std::size_t& region) const noexcept
+                {
+                    for (std::size_t i = 0; i < this->_range; ++i)
+                        if (region >= this->_ranges[i].first && region < this->_ranges[i].second) return true;
+
+                    return this->_range < this->_ranges.size()
+                        && region >= this->_ranges[this->_range].first && region < this->_region;
+                }
+
+                void advance() noexcept
+                {
+                    if (++this->_region < this->_ranges[this->_range].second) return;
+
+                    if (++this->_range < this->_ranges.size()) this->_region = this->_ranges[this->_range].first;
+                }
+            };
+
+            /**
+             * @brief A bucket of the window a bulk erase
+             * compacts, with the offset of its entry's home
+             * bucket from the start of the window
+             *
+             */
+            struct window_bucket
+            {
+                word_type _word, _new_word;
+                std::ptrdiff_t _home;
+                bool _erase;
+            };
+
+            std::vector<level> _levels;
+            std::vector<entry_type*> _entries;
+            std::vector<window_bucket> _window;
+
+            friend class concurrent_robin_hash;
+
+        public:
+            bool done() const noexcept
+            {
+                return this->_levels.empty() || this->_levels.back()._range == this->_levels.back()._ranges.size();
+            }
+        };
+
+    private:
+        /**
+         * @brief Entries of a table displaced past the cap. The
+         * count sits on a line of its own, as every lookup that
+         * misses reads it
+         *
+         */
+        struct overflow_stash
+        {
+            alignas(128) std::atomic<word_type> _count{S_EMPTY};
+            alignas(128) std::atomic<word_type> _slots[S_STASH_SIZE]{};
+        };
+
+        struct no_stash {};
+
+        using stash = typename std::conditional<S_BOUNDED, overflow_stash, no_stash>::type;
+
+        /**
+         * @brief A bucket array together with the timestamps
+         * guarding its regions and the state of its migration
+         *
+         */
+        struct resizable_table
+        {
+            std::size_t _size, _size_mask, _num_timestamps, _generation;
+
+            std::unique_ptr<std::atomic<word_type>[]> _buckets, _timestamps;
+
+            stash _stash;
+
+            std::atomic<resizable_table*> _next{nullptr};
+            
+            // Chunks of the previous table claimed and finished by helpers
+            std::atomic<std::size_t> _migration_claimed{0}, _migration_done{0};
+
+            explicit
+            resizable_table(const std::size_t& size, const std::size_t& generation = 0) :
+                _size(size),
+                _size_mask(size - 1),
+                _num_timestamps(std::max<std::size_t>(size >> S_TIMESTAMP_SHIFT, 1)),
+                _generation(generation),
+                _buckets(new std::atomic<word_type>[size]()),
+                _timestamps(new std::atomic<word_type>[_num_timestamps]()) {}
+        };
+
+        /**
+         * @brief A bucket array of compile time size. Its size and
+         * mask are constants, so mapping a hash to a bucket folds
+         *
+         */
+        struct fixed_table
+        {
+            static constexpr std::size_t _size = Buckets, _size_mask = Buckets - 1;
+            static constexpr std::size_t _num_timestamps = std::max<std::size_t>(Buckets >> S_TIMESTAMP_SHIFT, 1);
+            static constexpr std::size_t _generation = 0;
+
+            std::atomic<word_type> _buckets[Buckets]{}, _timestamps[_num_timestamps]{};
+
+            stash _stash;
+        };
+
+        using table = typename std::conditional<S_FIXED, fixed_table, resizable_table>::type;
+
+        struct region
+        {
+            std::size_t _index;
+
+            word_type _timestamp;
+
+            bool _written;
+        };
+
+        struct alignas(128) thread_counter
+        {
+            std::atomic<std::ptrdiff_t> _size{0};
+
+            unsigned _inserts_since_check = 0, _erases_since_check = 0;
+        };
+
+        enum class probe_result
+        {
+            DONE,
+            EXISTS,
+            ABSENT,
+            CONTENDED,
+            MOVED,
+            OVERFLOW,
+            STASHED,
+            PARTIAL,
+            STALE
+        };
+
+        Hash _hash;
+        KeyEqual _key_equal;
+        MapToBucket _map_to_bucket;
+        entry_allocator _entry_allocator;
+
+        unsigned _threads;
+
+        // The bucket count the table was constructed with, below which it never shrinks
+        std::size_t _initial_size;
+
+        // The kCAS is declared first so it outlives the reclaimer, whose destructor releases descriptors through it
+        KCAS _kcas;
+        MemReclaimer _reclaimer;
+
+        typename std::conditional<S_FIXED, fixed_table, std::atomic<table*>>::type _table;
+
+        // The exponent of the published table's size under its generation, read by bucket_count without a pin
+        std::atomic<std::size_t> _bucket_count{0};
+
+        std::unique_ptr<thread_counter[]> _counters;
+
+        // Entries a fixed table has taken or promised to an insert in flight, kept apart from the per-thread sizes
+        alignas(128) std::atomic<std::size_t> _reserved{0};
+
+        static
+        std::size_t round_up_to_power_of_two(std::size_t value) noexcept
+        {
+            std::size_t power = S_MIN_BUCKETS;
+            while (power < value) power <<= 1;
+            return power;
+        }
+
+        static
+        constexpr
+        bool is_moved(const word_type& word) noexcept
+        {
+            return !S_FIXED && (word & S_MOVED);
+        }
+
+        static
+        entry_type* to_entry(const word_type& word) noexcept
+        {
+            return reinterpret_cast<entry_type*>(word & ~S_MOVED);
+        }
+
+        static
+        word_type to_word(const entry_type* entry) noexcept
+        {
+            return reinterpret_cast<word_type>(entry);
+        }
+
+        static
+        void delete_entry(void* context, void* ptr) noexcept
+        {
+            static_cast<concurrent_robin_hash*>(context)->destroy_entry(static_cast<entry_type*>(ptr));
+        }
+
+        static
+        void delete_table(void*, void* ptr) noexcept
+        {
+            delete static_cast<table*>(ptr);
+        }
+
+        template< typename... Args >
+        entry_type* create_entry(Args&&... args)
+        {
+            entry_type* entry = std::allocator_traits<entry_allocator>::allocate(this->_entry_allocator, 1);
+            try
+            {
+                std::allocator_traits<entry_allocator>::construct(this->_entry_allocator, entry, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                std::allocator_traits<entry_allocator>::deallocate(this->_entry_allocator, entry, 1);
+                throw;
+            }
+            return entry;
+        }
+
+        void destroy_entry(entry_type* entry) noexcept
+        {
+            std::allocator_traits<entry_allocator>::destroy(this->_entry_allocator, entry);
+            std::allocator_traits<entry_allocator>::deallocate(this->_entry_allocator, entry, 1);
+        }
+
+        hash_type entry_hash(const entry_type* entry) const
+        {
+            if constexpr (StoreHash) return entry->stored_hash();
+            else return this->_hash(KeySelect()(entry->value()));
+        }
+
+        std::size_t bucket_for_hash(const hash_type& hash, const table* t) const noexcept
+        {
+            return this->_map_to_bucket(hash, t->_size);
+        }
+
+        std::size_t distance(const entry_type* entry, const std::size_t& index, const table* t) const
+        {
+            return (index - this->bucket_for_hash(this->entry_hash(entry), t)) & t->_size_mask;
+        }
+
+        /**
+         * @brief Records the timestamp of the region holding a
+         * bucket the first time the region is visited
+         *
+         * @return region* The record of the region, or nullptr
+         * if no more regions fit into a single kCAS
+         */
+        region* visit_region(const table* t, const std::size_t& index, region* regions, std::size_t& num_regions) const noexcept
+        {
+            const std::size_t region_index = index >> S_TIMESTAMP_SHIFT;
+
+            for (std::size_t i = num_regions; i-- > 0;)
+                if (regions[i]._index == region_index) return regions + i;
+
+            if (num_regions == S_MAX_ENTRIES) return nullptr;
+
+            regions[num_regions] = region{region_index, this->_kcas.read(t->_timestamps[region_index]), false};
+            return regions + num_regions++;
+        }
+
+        bool validate_regions(const table* t, const region* regions, const std::size_t& num_regions) const noexcept
+        {
+            for (std::size_t i = 0; i < num_regions; ++i)
+                if (this->_kcas.read(t->_timestamps[regions[i]._index], Ordering::S_VALIDATE) != regions[i]._timestamp)
+                    return false;
+            return true;
+        }
+
+        /**
+         * @brief Appends the timestamp of every visited region
+         * to a kCAS, advancing those whose buckets are written
+         * and leaving the others as a consistency check
+         *
+         */
+        bool commit(const unsigned& thread_id, table* t,
+            kcas_entry_type* entries, std::size_t num_entries,
+            const region* regions, const std::size_t& num_regions) noexcept
+        {
+            for (std::size_t i = 0; i < num_regions; ++i)
+            {
+                entries[num_entries++] = kcas_entry_type{&t->_timestamps[regions[i]._index],
+                    regions[i]._timestamp,
+                    regions[i]._written ? regions[i]._timestamp + S_TIMESTAMP_INCREMENT : regions[i]._timestamp};
+            }
+
+            return this->_kcas.cas(thread_id, entries, entries + num_entries);
+        }
+
+        /**
+         * @brief Finds the stashed entry holding a key. The count
+         * is read first, so an empty stash costs a single load
+         *
+         * @return probe_result STASHED with the slot and word of
+         * the entry, ABSENT, or MOVED if the stash is migrating
+         */
+        template< class K >
+        probe_result find_stashed(const table* t, const K& key, const hash_type& hash,
+            std::size_t& slot, word_type& word) const
+        {
+            if constexpr (S_BOUNDED)
+            {
+                if (this->_kcas.read(t->_stash._count) == S_EMPTY) return probe_result::ABSENT;
+
+                for (slot = 0; slot < S_STASH_SIZE; ++slot)
+                {
+                    word = this->_kcas.read(t->_stash._slots[slot]);
+
+                    if (is_moved(word)) return probe_result::MOVED;
+                    if (word == S_EMPTY) continue;
+
+                    const entry_type* entry = to_entry(word);
+                    if (entry->bucket_hash_equal(hash) && this->_key_equal(KeySelect()(entry->value()), key))
+                        return probe_result::STASHED;
+                }
+            }
+            return probe_result::ABSENT;
+        }
+
+        /**
+         * @brief Robin hood probe for a key
+         *
+         * @return probe_result DONE with the index and word of
+         * the matching bucket, STASHED with the slot and word of
+         * the matching stash entry, ABSENT if the key is in
+         * neither, or CONTENDED / MOVED if the probe must restart
+         */
+        template< class K >
+        probe_result probe(const table* t, const K& key, const hash_type& hash,
+            std::size_t& index, word_type& word,
+            region* regions, std::size_t& num_regions) const
+        {
+            const std::size_t home = this->bucket_for_hash(hash, t);
+            const std::size_t last = S_BOUNDED ? std::min(t->_size_mask, MaxDisplacement) : t->_size_mask;
+            num_regions = 0;
+
+            for (std::size_t dist = 0; dist <= last; ++dist)
+            {
+                index = (home + dist) & t->_size_mask;
+
+                if (!this->visit_region(t, index, regions, num_regions)) return probe_result::CONTENDED;
+
+                word = this->_kcas.read(t->_buckets[index]);
+
+                if (is_moved(word)) return probe_result::MOVED;
+                if (word == S_EMPTY) break;
+
+                const entry_type* entry = to_entry(word);
+
+                if (this->distance(entry, index, t) < dist) break;
+
+                if (entry->bucket_hash_equal(hash) && this->_key_equal(KeySelect()(entry->value()), key))
+                    return probe_result::DONE;
+            }
+
+            const probe_result stashed = this->find_stashed(t, key, hash, index, word);
+            if (stashed != probe_result::ABSENT) return stashed;
+
+            return this->validate_regions(t, regions, num_regions) ? probe_result::ABSENT : probe_result::CONTENDED;
+        }
+
+        /**
+         * @brief Completes an insertion that would push the
+         * carried entry past the cap by putting it into a free
+         * stash slot, in the same kCAS as the swaps so far
+         *
+         * @return probe_result STASHED once committed, EXISTS if
+         * the key is already stashed, OVERFLOW if the stash is full
+         */
+        probe_result stash_carried(const unsigned& thread_id, table* t, const entry_type* entry,
+            const hash_type& hash, const bool& check_existing, const word_type& carried,
+            kcas_entry_type* entries, std::size_t num_entries,
+            region* regions, std::size_t num_regions)
+        {
+            std::size_t slot;
+            word_type word;
+
+            if (check_existing)
+            {
+                const probe_result stashed = this->find_stashed(t, KeySelect()(entry->value()), hash, slot, word);
+                if (stashed != probe_result::ABSENT) return stashed == probe_result::STASHED ? probe_result::EXISTS : stashed;
+            }
+
+            const word_type count = this->_kcas.read(t->_stash._count);
+            if (count == S_STASH_SIZE * S_STASH_COUNT_INCREMENT) return probe_result::OVERFLOW;
+
+            for (slot = 0; slot < S_STASH_SIZE; ++slot)
+            {
+                word = this->_kcas.read(t->_stash._slots[slot]);
+
+                if (is_moved(word)) return probe_result::MOVED;
+                if (word == S_EMPTY) break;
+            }
+
+            // The count said otherwise, so a slot was just taken
+            if (slot == S_STASH_SIZE) return probe_result::CONTENDED;
+
+            // Advancing the home region fails a racing insertion of the same key into the table, and
+            // advancing that of the carried entry fails a scan of its region reading the stash
+            regions[0]._written = true;
+
+            const std::size_t carried_home = this->bucket_for_hash(this->entry_hash(to_entry(carried)), t);
+
+            region* home = this->visit_region(t, carried_home, regions, num_regions);
+            if (!home) return probe_result::OVERFLOW;
+            home->_written = true;
+
+            entries[num_entries++] = kcas_entry_type{&t->_stash._slots[slot], S_EMPTY, carried};
+            entries[num_entries++] = kcas_entry_type{&t->_stash._count, count, count + S_STASH_COUNT_INCREMENT};
+
+            return this->commit(thread_id, t, entries, num_entries, regions, num_regions) ?
+                probe_result::STASHED : probe_result::CONTENDED;
+        }
+
+        /**
+         * @brief Robin hood insertion of an entry. Every bucket
+         * from the first displacement up to the empty bucket that
+         * ends the chain is swapped in one kCAS. Under a cap the
+         * chain ends in the stash as soon as it runs more than
+         * MaxDisplacement buckets past its first swap
+         *
+         * @param check_existing Whether to look for an entry with
+         * the same key first; migrations never find one
+         * @return probe_result DONE, or STASHED if an entry went
+         * into the stash
+         */
+        probe_result try_insert(const unsigned& thread_id, table* t, entry_type* entry,
+            const hash_type& hash, const bool& check_existing)
+        {
+            kcas_entry_type entries[S_MAX_ENTRIES];
+            region regions[S_MAX_ENTRIES];
+            std::size_t num_entries = 0, num_regions = 0;
+
+            const std::size_t home = this->bucket_for_hash(hash, t);
+
+            word_type carried = to_word(entry), previous = S_EMPTY;
+            std::size_t carried_dist = 0, first_swap = 0;
+
+            for (std::size_t dist = 0; ; ++dist, ++carried_dist)
+            {
+                if (dist > t->_size_mask) return probe_result::OVERFLOW;
+
+                if constexpr (S_BOUNDED)
+                {
+                    // Neither the carried entry nor the chain of swaps may run past the cap
+                    if (carried_dist > MaxDisplacement || (num_entries != 0 && dist - first_swap > MaxDisplacement))
+                        return this->stash_carried(thread_id, t, entry, hash, check_existing, carried,
+                            entries, num_entries, regions, num_regions);
+                }
+
+                const std::size_t index = (home + dist) & t->_size_mask;
+
+                region* r = this->visit_region(t, index, regions, num_regions);
+                if (!r || num_entries + num_regions + S_STASH_WORDS >= S_MAX_ENTRIES) return probe_result::OVERFLOW;
+
+                const word_type word = this->_kcas.read(t->_buckets[index]);
+
+                if (is_moved(word)) return probe_result::MOVED;
+
+                if (word == S_EMPTY)
+                {
+                    entries[num_entries++] = kcas_entry_type{&t->_buckets[index], word, carried};
+                    r->_written = true;
+                    break;
+                }
+
+                if (word == previous)
+                    return this->shift_stale(thread_id, t, index) ? probe_result::CONTENDED : probe_result::MOVED;
+
+                previous = word;
+
+                const entry_type* occupant = to_entry(word);
+
+                // A migration meets its entry again when it freezes a stale copy as well
+                if (num_entries == 0 && occupant == entry) return probe_result::EXISTS;
+
+                if (check_existing && num_entries == 0 && occupant->bucket_hash_equal(hash)
+                    && this->_key_equal(KeySelect()(occupant->value()), KeySelect()(entry->value())))
+                    return probe_result::EXISTS;
+
+                const std::size_t occupant_dist = this->distance(occupant, index, t);
+
+                if (occupant_dist < carried_dist)
+                {
+                    if (num_entries == 0) first_swap = dist;
+
+                    entries[num_entries++] = kcas_entry_type{&t->_buckets[index], word, carried};
+                    r->_written = true;
+                    carried = word;
+                    carried_dist = occupant_dist;
+                }
+            }
+
+            if (S_BOUNDED && check_existing)
+            {
+                std::size_t slot;
+                word_type word;
+
+                const probe_result stashed = this->find_stashed(t, KeySelect()(entry->value()), hash, slot, word);
+                if (stashed != probe_result::ABSENT) return stashed == probe_result::STASHED ? probe_result::EXISTS : stashed;
+            }
+
+            return this->commit(thread_id, t, entries, num_entries, regions, num_regions) ?
+                probe_result::DONE : probe_result::CONTENDED;
+        }
+
+        /**
+         * @brief One kCAS of a backward shift that empties the
+         * bucket at index. Each following bucket moves back by one
+         * until an empty bucket or an entry at its home closes the
+         * run. A run too long for one kCAS, or under a cap longer
+         * than MaxDisplacement + 1 buckets, is shifted in steps: a
+         * step that stops early leaves its last bucket holding a
+         * stale copy of the entry before it. Lookups pass over the
+         * copy as over the entry itself, scans skip it, and a writer
+         * that meets one closes it with shift_stale first
+         *
+         * @param index The bucket to empty; after PARTIAL the bucket
+         * left holding a stale copy, after STALE a stale copy met
+         * further on that must be closed first
+         * @param word Its word, likewise
+         * @param stale Whether the bucket holds a stale copy rather
+         * than an entry being erased
+         * @return probe_result DONE once the run is closed, PARTIAL,
+         * STALE, CONTENDED or MOVED
+         */
+        probe_result shift_step(const unsigned& thread_id, table* t, std::size_t& index, word_type& word, const bool& stale)
+        {
+            kcas_entry_type entries[S_MAX_ENTRIES];
+            region regions[S_MAX_ENTRIES];
+            std::size_t num_entries = 0, num_regions = 0, at = index;
+            word_type at_word = word;
+
+            // A stale copy is only shifted while the entry it copies still precedes it
+            if (stale) entries[num_entries++] = kcas_entry_type{&t->_buckets[(at - 1) & t->_size_mask], at_word, at_word};
+
+            for (;;)
+            {
+                const std::size_t next = (at + 1) & t->_size_mask;
+
+                region* written = this->visit_region(t, at, regions, num_regions);
+                this->visit_region(t, next, regions, num_regions);
+                written->_written = true;
+
+                const word_type next_word = this->_kcas.read(t->_buckets[next]);
+
+                if (is_moved(next_word)) return probe_result::MOVED;
+
+                if (next_word == at_word)
+                {
+                    index = next;
+                    return probe_result::STALE;
+                }
+
+                if (next_word == S_EMPTY || this->distance(to_entry(next_word), next, t) == 0)
+                {
+                    entries[num_entries++] = kcas_entry_type{&t->_buckets[at], at_word, S_EMPTY};
+
+                    return this->commit(thread_id, t, entries, num_entries, regions, num_regions) ?
+                        probe_result::DONE : probe_result::CONTENDED;
+                }
+
+                entries[num_entries++] = kcas_entry_type{&t->_buckets[at], at_word, next_word};
+                at = next;
+                at_word = next_word;
+
+                // The next bucket may add two regions
+                if (num_entries + num_regions + 3 > S_MAX_ENTRIES || (S_BOUNDED && num_entries > MaxDisplacement))
+                {
+                    if (!this->commit(thread_id, t, entries, num_entries, regions, num_regions)) return probe_result::CONTENDED;
+
+                    index = at;
+                    word = at_word;
+                    return probe_result::PARTIAL;
+                }
+            }
+        }
+
+        /**
+         * @brief Closes the stale copy in a bucket, and any met
+         * further on, by shifting the run behind it back step by
+         * step. Stops early once the bucket holds no stale copy, as
+         * the thread that moved it on then finishes the shift
+         *
+         * @return false if the table is migrating
+         */
+        bool shift_stale(const unsigned& thread_id, table* t, std::size_t index)
+        {
+            Backoff backoff;
+            for (;;)
+            {
+                word_type word = this->_kcas.read(t->_buckets[index]);
+                const word_type previous = this->_kcas.read(t->_buckets[(index - 1) & t->_size_mask]);
+
+                if (is_moved(word) || is_moved(previous)) return false;
+                if (word == S_EMPTY || word != previous) return true;
+
+                std::size_t at = index;
+                switch (this->shift_step(thread_id, t, at, word, true))
+                {
+                case probe_result::DONE:
+                    return true;
+                case probe_result::PARTIAL:
+                    index = at;
+                    break;
+                case probe_result::STALE:
+                    if (!this->shift_stale(thread_id, t, at)) return false;
+                    break;
+                case probe_result::MOVED:
+                    return false;
+                default:
+                    backoff();
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Robin hood erasure with backward shift. The key
+         * is gone once the first step of the shift commits; the
+         * erasing thread then finishes the remaining steps itself
+         *
+         */
+        template< class K >
+        probe_result try_erase(const unsigned& thread_id, table* t, const K& key,
+            const hash_type& hash, entry_type*& erased)
+        {
+            region regions[S_MAX_ENTRIES];
+            std::size_t num_regions = 0, index;
+            word_type word;
+
+            const probe_result found = this->probe(t, key, hash, index, word, regions, num_regions);
+
+            if constexpr (S_BOUNDED)
+            {
+                if (found == probe_result::STASHED)
+                {
+                    erased = to_entry(word);
+
+                    // The probe visited the home region first, and scans of it read the stash
+                    regions[0]._written = true;
+
+                    const word_type count = this->_kcas.read(t->_stash._count);
+                    kcas_entry_type entries[S_MAX_ENTRIES];
+                    entries[0] = kcas_entry_type{&t->_stash._slots[index], word, S_EMPTY};
+                    entries[1] = kcas_entry_type{&t->_stash._count, count, count - S_STASH_COUNT_INCREMENT};
+
+                    return this->commit(thread_id, t, entries, 2, regions, num_regions) ?
+                        probe_result::DONE : probe_result::CONTENDED;
+                }
+            }
+
+            if (found != probe_result::DONE) return found;
+
+            erased = to_entry(word);
+
+            switch (const probe_result shifted = this->shift_step(thread_id, t, index, word, false))
+            {
+            case probe_result::PARTIAL:
+                this->shift_stale(thread_id, t, index);
+                return probe_result::DONE;
+            case probe_result::STALE:
+                return this->shift_stale(thread_id, t, index) ? probe_result::CONTENDED : probe_result::MOVED;
+            default:
+                return shifted;
+            }
+        }
+
+        void start_resize(const unsigned& thread_id, table* t, const std::size_t& size)
+        {
+            table* next = new table(round_up_to_power_of_two(size), t->_generation + 1);
+            table* expected = nullptr;
+
+            if (!t->_next.compare_exchange_strong(expected, next, Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE)) delete next;
+
+            this->help_migrate(thread_id, t);
+        }
+
+        /**
+         * @brief Freezes a bucket or stash slot of a table under
+         * migration and re-inserts its entry into the next table.
+         * Frozen words keep their entry, so a migration that is
+         * restarted into a larger table picks them up again; a stale
+         * copy finds its entry already there
+         *
+         * @return false if the entry does not fit into a single
+         * kCAS in the next table
+         */
+        bool migrate_bucket(const unsigned& thread_id, std::atomic<word_type>& bucket, table* next)
+        {
+            word_type word = this->_kcas.read(bucket);
+            while (!(word & S_MOVED))
+            {
+                kcas_entry_type freeze{&bucket, word, word | S_MOVED};
+                if (this->_kcas.cas(thread_id, &freeze, &freeze + 1)) break;
+
+                word = this->_kcas.read(bucket);
+            }
+
+            entry_type* entry = to_entry(word);
+            if (!entry) return true;
+
+            const hash_type hash = this->entry_hash(entry);
+
+            Backoff backoff;
+            for (;;)
+            {
+                switch (this->try_insert(thread_id, next, entry, hash, false))
+                {
+                case probe_result::DONE:
+                case probe_result::STASHED:
+                case probe_result::EXISTS:
+                    return true;
+                case probe_result::OVERFLOW:
+                    return false;
+                default:
+                    backoff();
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Migrates chunks of a table until none are left,
+         * waits for the other helpers to finish theirs and then
+         * installs the next table. Chunk counters live in the next
+         * table, so replacing a target that overflowed starts the
+         * migration over. The replacement is at least as large as
+         * the table being migrated, which held the same entries,
+         * so a shrink that overflows is retried once rather than
+         * doubling its way back up
+         *
+         */
+        void help_migrate(const unsigned& thread_id, table* t)
+        {
+            const std::size_t bucket_chunks = (t->_size + S_MIGRATION_CHUNK - 1) / S_MIGRATION_CHUNK;
+            const std::size_t chunks = bucket_chunks + S_STASH_CHUNKS;
+
+            for (;;)
+            {
+                table* next = t->_next.load(Ordering::S_LOAD);
+                bool overflowed = false;
+
+                for (std::size_t chunk; !overflowed && (chunk = next->_migration_claimed.fetch_add(1, Ordering::S_COUNTER)) < chunks;)
+                {
+                    if constexpr (S_BOUNDED)
+                    {
+                        if (chunk == bucket_chunks)
+                        {
+                            for (std::size_t i = 0; i < S_STASH_SIZE && !overflowed; ++i)
+                                overflowed = !this->migrate_bucket(thread_id, t->_stash._slots[i], next);
+
+                            if (!overflowed) next->_migration_done.fetch_add(1, Ordering::S_UPDATE);
+                            continue;
+                        }
+                    }
+
+                    const std::size_t last = std::min(t->_size, (chunk + 1) * S_MIGRATION_CHUNK);
+
+                    for (std::size_t i = chunk * S_MIGRATION_CHUNK; i < last && !overflowed; ++i)
+                        overflowed = !this->migrate_bucket(thread_id, t->_buckets[i], next);
+
+                    if (!overflowed) next->_migration_done.fetch_add(1, Ordering::S_UPDATE);
+                }
+
+                if (overflowed)
+                {
+                    table* larger = new table(std::max(next->_size * 2, t->_size), next->_generation + 1);
+                    table* expected = next;
+
+                    if (t->_next.compare_exchange_strong(expected, larger, Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE))
+                        this->_reclaimer.template retire<Ordering>(thread_id, record_handle{next, nullptr, &delete_table});
+                    else
+                        delete larger;
+                    continue;
+                }
+
+                Backoff backoff;
+                while (next->_migration_done.load(Ordering::S_LOAD) < chunks && t->_next.load(Ordering::S_LOAD) == next) backoff();
+
+                if (t->_next.load(Ordering::S_LOAD) != next) continue;
+
+                table* expected = t;
+                if (this->_table.compare_exchange_strong(expected, next, Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE))
+                {
+                    this->publish_bucket_count(next);
+                    this->_reclaimer.template retire<Ordering>(thread_id, record_handle{t, nullptr, &delete_table});
+                }
+                return;
+            }
+        }
+
+        /**
+         * @brief Records the size of a table just published. A
+         * winner delayed past the next migration would overwrite
+         * a newer size, so only a later generation replaces it
+         *
+         */
+        void publish_bucket_count(const table* t) noexcept
+        {
+            unsigned exponent = 0;
+            while ((std::size_t(1) << exponent) < t->_size) ++exponent;
+
+            const std::size_t published = (t->_generation << S_BUCKET_COUNT_SHIFT) | exponent;
+            std::size_t current = this->_bucket_count.load(Ordering::S_LOAD);
+
+            while ((current >> S_BUCKET_COUNT_SHIFT) < t->_generation || current == 0)
+                if (this->_bucket_count.compare_exchange_weak(current, published, Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE)) return;
+        }
+
+        table* current_table(const unsigned& thread_id)
+        {
+            if constexpr (S_FIXED) return &this->_table;
+            else
+            {
+                for (;;)
+                {
+                    table* t = this->_table.load(Ordering::S_LOAD);
+
+                    if (!t->_next.load(Ordering::S_LOAD)) return t;
+
+                    this->help_migrate(thread_id, t);
+                }
+            }
+        }
+
+        void help_resize(const unsigned& thread_id, table* t)
+        {
+            if constexpr (!S_FIXED) this->help_migrate(thread_id, t);
+        }
+
+        /**
+         * @brief Whether the buckets the cap allows from the home
+         * of a hash and the whole stash all hold entries of that
+         * very hash. A table of any size then has no room for one
+         * more, since equal hashes share a home in every table
+         *
+         */
+        bool hash_saturated(table* t, const hash_type& hash)
+        {
+            if constexpr (S_BOUNDED)
+            {
+                const std::size_t home = this->bucket_for_hash(hash, t);
+                std::size_t count = 0;
+                word_type previous = S_EMPTY;
+
+                for (std::size_t dist = 0; dist <= std::min(MaxDisplacement, t->_size_mask); ++dist)
+                {
+                    const word_type word = this->_kcas.read(t->_buckets[(home + dist) & t->_size_mask]);
+
+                    // A stale copy repeats the entry before it
+                    if (word != previous && to_entry(word) && this->entry_hash(to_entry(word)) == hash) ++count;
+                    previous = word;
+                }
+
+                for (std::atomic<word_type>& slot : t->_stash._slots)
+                {
+                    const word_type word = this->_kcas.read(slot);
+                    if (to_entry(word) && this->entry_hash(to_entry(word)) == hash) ++count;
+                }
+
+                return count >= S_STASH_SIZE + MaxDisplacement + 1;
+            }
+            else return false;
+        }
+
+        /**
+         * @brief Whether a table is already as sparse as an overflow
+         * may make it. Keys whose hashes agree in their low bits
+         * share a home until the table outgrows those bits, so
+         * doubling for them could go on until allocation fails
+         *
+         */
+        bool overflow_bound_reached(table* t)
+        {
+            const std::size_t loaded = round_up_to_power_of_two(this->size() * S_MAX_LOAD_DENOMINATOR / S_MAX_LOAD_NUMERATOR + 1);
+            return t->_size >= (std::max(this->_initial_size, loaded) << S_MAX_OVERFLOW_DOUBLINGS);
+        }
+
+        /**
+         * @brief Grows a table an insertion of a hash overflowed,
+         * unless no table could take the hash or the table is
+         * already far sparser than its load calls for, where the
+         * insertion fails rather than doubling the table without end
+         *
+         */
+        void grow(const unsigned& thread_id, table* t, const hash_type& hash)
+        {
+            if constexpr (S_FIXED) throw std::length_error("fixed capacity table cannot hold the probe sequence.");
+            else
+            {
+                if (this->hash_saturated(t, hash))
+                    throw std::length_error("too many keys share a hash for any table size to hold them.");
+
+                if (this->overflow_bound_reached(t))
+                    throw std::length_error("too many keys share a home bucket for the load of the table.");
+
+                this->start_resize(thread_id, t, t->_size * 2);
+            }
+        }
+
+        void maybe_grow(const unsigned& thread_id, table* t)
+        {
+            if constexpr (!S_FIXED)
+            {
+                thread_counter& counter = this->_counters[thread_id];
+                if (++counter._inserts_since_check < S_LOAD_CHECK_INTERVAL) return;
+
+                counter._inserts_since_check = 0;
+
+                const std::size_t count = this->size();
+                if (count * S_MAX_LOAD_DENOMINATOR > t->_size * S_MAX_LOAD_NUMERATOR)
+                    this->start_resize(thread_id, t, t->_size * 2);
+            }
+        }
+
+        /**
+         * @brief Grows the table early once the stash is half
+         * full, unless the table is under half its maximum load;
+         * a sparse table only overflows on colliding hashes, which
+         * no size spreads apart
+         *
+         */
+        void maybe_grow_for_stash(const unsigned& thread_id, table* t)
+        {
+            if constexpr (!S_FIXED && S_BOUNDED)
+            {
+                if (this->_kcas.read(t->_stash._count) < S_STASH_SIZE / 2 * S_STASH_COUNT_INCREMENT) return;
+
+                if (this->size() * S_MAX_LOAD_DENOMINATOR * 2 >= t->_size * S_MAX_LOAD_NUMERATOR)
+                    this->start_resize(thread_id, t, t->_size * 2);
+            }
+        }
+
+        /**
+         * @brief Migrates into the smallest array that holds the
+         * remaining entries at half the maximum load, once the
+         * load has fallen below the minimum and the stash is empty
+         *
+         */
+        void maybe_shrink(const unsigned& thread_id, table* t)
+        {
+            if constexpr (!S_FIXED && MinLoad != 0)
+            {
+                thread_counter& counter = this->_counters[thread_id];
+                if (++counter._erases_since_check < S_LOAD_CHECK_INTERVAL) return;
+
+                counter._erases_since_check = 0;
+                this->shrink_if_sparse(thread_id, t);
+            }
+        }
+
+        void shrink_if_sparse(const unsigned& thread_id, table* t)
+        {
+            if constexpr (!S_FIXED && MinLoad != 0)
+            {
+                if (t->_size <= this->_initial_size) return;
+
+                // A table still stashing entries is too crowded for the cap, however few it holds
+                if constexpr (S_BOUNDED)
+                {
+                    if (this->_kcas.read(t->_stash._count) != S_EMPTY) return;
+                }
+
+                const std::size_t count = this->size();
+                if (count * 100 >= t->_size * MinLoad) return;
+
+                const std::size_t size = std::max(this->_initial_size,
+                    round_up_to_power_of_two(count * S_MAX_LOAD_DENOMINATOR * 2 / S_MAX_LOAD_NUMERATOR));
+                if (size < t->_size) this->start_resize(thread_id, t, size);
+            }
+        }
+
+        /**
+         * @brief Erases the entries homed in a region that match
+         * a predicate with a single kCAS. The window runs from the
+         * start of the region to the first empty bucket, or entry
+         * in its home bucket, past its end; the kept entries of the
+         * window are shifted back towards their homes in order, as
+         * one backward shift per erased entry would leave them, and
+         * stale copies left by a backward shift go with the erased
+         * entries. Matching stashed entries homed in the region
+         * leave the stash in the same kCAS. The erased entries are
+         * left in the cursor
+         *
+         * @return probe_result DONE once committed or if nothing
+         * matched, OVERFLOW if the window does not fit into a
+         * single kCAS, or CONTENDED / MOVED if it must be retried
+         */
+        template< class P >
+        probe_result erase_region(const unsigned& thread_id, table* t, const std::size_t& region_index,
+            scan_cursor& cursor, P& pred)
+        {
+            using window_bucket = typename scan_cursor::window_bucket;
+
+            kcas_entry_type entries[S_MAX_ENTRIES];
+            region regions[S_MAX_ENTRIES];
+            std::size_t num_entries = 0, num_regions = 0;
+
+            const std::size_t buckets = region_buckets(t->_size), start = region_index * buckets;
+
+            cursor._entries.clear();
+            cursor._window.clear();
+
+            word_type previous = S_EMPTY;
+
+            std::size_t i = 0;
+            for (; i < t->_size; ++i)
+            {
+                const std::size_t index = (start + i) & t->_size_mask;
+
+                if (!this->visit_region(t, index, regions, num_regions)) return probe_result::OVERFLOW;
+
+                const word_type word = this->_kcas.read(t->_buckets[index]);
+                if (is_moved(word)) return probe_result::MOVED;
+
+                entry_type* entry = to_entry(word);
+                if (!entry)
+                {
+                    if (i >= buckets) break;
+
+                    cursor._window.push_back(window_bucket{word, S_EMPTY, 0, false});
+                    previous = word;
+                    continue;
+                }
+
+                const hash_type hash = this->entry_hash(entry);
+                const std::size_t dist = (index - this->bucket_for_hash(hash, t)) & t->_size_mask;
+
+                if (i >= buckets && dist == 0) break;
+
+                // A stale copy left by a backward shift is compacted away with the erased entries
+                const bool stale = word == previous;
+                previous = word;
+
+                const std::ptrdiff_t home = std::ptrdiff_t(i) - std::ptrdiff_t(dist);
+                const bool erase = !stale && home >= 0 && std::size_t(home) < buckets && this->reportable(cursor, hash)
+                    && pred(static_cast<const value_type&>(entry->value()));
+
+                if (erase) cursor._entries.push_back(entry);
+                cursor._window.push_back(window_bucket{word, S_EMPTY, home, erase || stale});
+            }
+
+            if (i == t->_size) return probe_result::OVERFLOW;
+
+            if constexpr (S_BOUNDED)
+            {
+                probe_result stashed = probe_result::DONE;
+                this->visit_stashed(t, region_index, [&](const std::size_t& slot, const word_type& word, const hash_type& hash)
+                {
+                    // The attempt is thrown away once it fails, so the predicate is not asked again
+                    if (stashed != probe_result::DONE) return;
+                    if (is_moved(word))
+                    {
+                        stashed = probe_result::MOVED;
+                        return;
+                    }
+
+                    entry_type* entry = to_entry(word);
+                    if (!this->reportable(cursor, hash) || !pred(static_cast<const value_type&>(entry->value()))) return;
+
+                    if (num_entries + num_regions + 1 >= S_MAX_ENTRIES)
+                    {
+                        stashed = probe_result::OVERFLOW;
+                        return;
+                    }
+
+                    entries[num_entries++] = kcas_entry_type{&t->_stash._slots[slot], word, S_EMPTY};
+                    cursor._entries.push_back(entry);
+                });
+
+                if (stashed != probe_result::DONE) return stashed;
+
+                if (num_entries != 0)
+                {
+                    const word_type count = this->_kcas.read(t->_stash._count);
+                    entries[num_entries] = kcas_entry_type{&t->_stash._count, count, count - num_entries * S_STASH_COUNT_INCREMENT};
+                    ++num_entries;
+
+                    this->visit_region(t, start, regions, num_regions)->_written = true;
+                }
+            }
+
+            if (cursor._entries.empty())
+                return this->validate_regions(t, regions, num_regions) ? probe_result::DONE : probe_result::CONTENDED;
+
+            std::ptrdiff_t free = 0;
+            for (std::size_t j = 0; j < cursor._window.size(); ++j)
+            {
+                const window_bucket& bucket = cursor._window[j];
+
+                if (bucket._word == S_EMPTY) free = std::ptrdiff_t(j) + 1;
+                else if (!bucket._erase)
+                {
+                    const std::ptrdiff_t position = std::max(free, bucket._home);
+                    cursor._window[position]._new_word = bucket._word;
+                    free = position + 1;
+                }
+            }
+
+            for (std::size_t j = 0; j < cursor._window.size(); ++j)
+            {
+                const window_bucket& bucket = cursor._window[j];
+                if (bucket._word == bucket._new_word) continue;
+
+                if (num_entries + num_regions >= S_MAX_ENTRIES) return probe_result::OVERFLOW;
+
+                const std::size_t index = (start + j) & t->_size_mask;
+                this->visit_region(t, index, regions, num_regions)->_written = true;
+                entries[num_entries++] = kcas_entry_type{&t->_buckets[index], bucket._word, bucket._new_word};
+            }
+
+            return this->commit(thread_id, t, entries, num_entries, regions, num_regions) ?
+                probe_result::DONE : probe_result::CONTENDED;
+        }
+
+        static
+        std::size_t region_buckets(const std::size_t& size) noexcept
+        {
+            return std::min(size, std::size_t(1) << S_TIMESTAMP_SHIFT);
+        }
+
+        std::size_t region_for_hash(const hash_type& hash, const std::size_t& size) const noexcept
+        {
+            return this->_map_to_bucket(hash, size) >> S_TIMESTAMP_SHIFT;
+        }
+
+        /**
+         * @brief Home regions of a table that can hold the entries
+         * a scan is responsible for. With modulo mapping these follow
+         * from the bucket range of the first level; any other mapping
+         * scans the whole table
+         *
+         */
+        std::vector<typename scan_cursor::region_range> candidate_regions(const scan_cursor& cursor, const table* t) const
+        {
+            using region_range = typename scan_cursor::region_range;
+
+            const typename scan_cursor::level& first = cursor._levels.front();
+
+            if constexpr (!std::is_same<MapToBucket, ops::modulo<std::size_t>>::value)
+                return {region_range(0, t->_num_timestamps)};
+
+            if (first._ranges.empty()) return {};
+
+            const std::size_t first_buckets = region_buckets(first._size), buckets = region_buckets(t->_size);
+            const std::size_t begin = first._ranges.front().first * first_buckets;
+            const std::size_t end = first._ranges.front().second * first_buckets;
+
+            std::vector<region_range> intervals;
+            if (t->_size >= first._size)
+            {
+                for (std::size_t offset = 0; offset < t->_size; offset += first._size)
+                    intervals.emplace_back(offset + begin, offset + end);
+            }
+            else if (end - begin >= t->_size)
+            {
+                intervals.emplace_back(0, t->_size);
+            }
+            else
+            {
+                const std::size_t wrapped = begin & t->_size_mask;
+                intervals.emplace_back(wrapped, std::min(wrapped + end - begin, t->_size));
+                if (wrapped + end - begin > t->_size) intervals.emplace_back(0, wrapped + end - begin - t->_size);
+            }
+
+            std::vector<region_range> ranges;
+            for (region_range& interval : intervals)
+                interval = region_range(interval.first / buckets, (interval.second + buckets - 1) / buckets);
+
+            std::sort(intervals.begin(), intervals.end());
+            for (const region_range& interval : intervals)
+            {
+                if (!ranges.empty() && interval.first <= ranges.back().second)
+                    ranges.back().second = std::max(ranges.back().second, interval.second);
+                else
+                    ranges.push_back(interval);
+            }
+            return ranges;
+        }
+
+        /**
+         * @brief Calls a function with the slot, word and hash of
+         * every stashed entry whose home bucket lies in a region.
+         * A stashed entry only comes or goes in a kCAS advancing
+         * its home region, so validating the region after the call
+         * covers the slots read as well
+         *
+         */
+        template< class F >
+        void visit_stashed(const table* t, const std::size_t& region_index, F&& f) const
+        {
+            if constexpr (S_BOUNDED)
+            {
+                if (this->_kcas.read(t->_stash._count) == S_EMPTY) return;
+
+                for (std::size_t slot = 0; slot < S_STASH_SIZE; ++slot)
+                {
+                    const word_type word = this->_kcas.read(t->_stash._slots[slot]);
+                    const entry_type* entry = to_entry(word);
+                    if (!entry) continue;
+
+                    const hash_type hash = this->entry_hash(entry);
+                    if (this->region_for_hash(hash, t->_size) == region_index) f(slot, word, hash);
+                }
+            }
+        }
+
+        bool reportable(const scan_cursor& cursor, const hash_type& hash) const noexcept
+        {
+            const std::size_t last = cursor._levels.size() - 1;
+            if (last == 0) return true;
+
+            const typename scan_cursor::level& first = cursor._levels.front();
+            const std::size_t first_region = this->region_for_hash(hash, first._size);
+
+            if (first._ranges.empty() || first_region < first._ranges.front().first
+                || first_region >= first._ranges.front().second)
+                return false;
+
+            for (std::size_t i = 0; i < last; ++i)
+            {
+                const typename scan_cursor::level& l = cursor._levels[i];
+                if (l.covered(this->region_for_hash(hash, l._size))) return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Collects the entries whose home bucket lies in a
+         * region. They sit in the region itself or in the tail of
+         * the cluster running past it, which ends at an empty bucket
+         * or at an entry whose home lies beyond the region, and in
+         * the stash. Stale copies left by a backward shift are
+         * skipped
+         *
+         * @return false if a concurrent operation changed the
+         * buckets read and the region must be read again
+         */
+        bool scan_region(const table* t, const std::size_t& region_index, scan_cursor& cursor) const
+        {
+            region regions[S_MAX_ENTRIES];
+            std::size_t num_regions = 0;
+
+            const std::size_t buckets = region_buckets(t->_size), start = region_index * buckets;
+
+            cursor._entries.clear();
+
+            word_type previous = S_EMPTY;
+            for (std::size_t i = 0; i < t->_size; ++i)
+            {
+                const std::size_t index = (start + i) & t->_size_mask;
+
+                if (!this->visit_region(t, index, regions, num_regions)) return false;
+
+                const word_type word = this->_kcas.read(t->_buckets[index]) & ~S_MOVED;
+                entry_type* entry = to_entry(word);
+                if (!entry)
+                {
+                    if (i >= buckets) break;
+
+                    previous = word;
+                    continue;
+                }
+
+                // A stale copy repeats the entry before it
+                if (word == previous) continue;
+                previous = word;
+
+                const hash_type hash = this->entry_hash(entry);
+                const std::size_t dist = (index - this->bucket_for_hash(hash, t)) & t->_size_mask;
+
+                if (dist > i) continue;
+                if (i - dist >= buckets) break;
+
+                if (this->reportable(cursor, hash)) cursor._entries.push_back(entry);
+            }
+
+            this->visit_stashed(t, region_index, [&](const std::size_t&, const word_type& word, const hash_type& hash)
+            {
+                if (this->reportable(cursor, hash)) cursor._entries.push_back(to_entry(word));
+            });
+
+            return this->validate_regions(t, regions, num_regions);
+        }
+
+    public:
+        concurrent_robin_hash(const std::size_t& size,
+            const unsigned& threads,
+            const Hash& hash = Hash(),
+            const KeyEqual& equal = KeyEqual(),
+            const Allocator& alloc = Allocator()) :
+            _hash(hash),
+            _key_equal(equal),
+            _entry_allocator(alloc),
+            _threads(threads),
+            _initial_size(S_FIXED ? Buckets : round_up_to_power_of_two(size)),
+            _kcas(threads, _reclaimer),
+            _reclaimer(threads),
+            _counters(std::make_unique<thread_counter[]>(threads))
+        {
+            if constexpr (!S_FIXED)
+            {
+                table* t = new table(this->_initial_size);
+                this->_table.store(t, Ordering::S_STORE);
+                this->publish_bucket_count(t);
+            }
+        }
+
+        concurrent_robin_hash(const concurrent_robin_hash&) = delete;
+        concurrent_robin_hash &operator=(const concurrent_robin_hash&) = delete;
+
+        ~concurrent_robin_hash()
+        {
+            table* t = this->current_table(0);
+
+            for (std::size_t i = 0; i < t->_size; ++i)
+            {
+                const word_type word = t->_buckets[i].load();
+                if (word != S_EMPTY && word != t->_buckets[(i - 1) & t->_size_mask].load()) this->destroy_entry(to_entry(word));
+            }
+
+            if constexpr (S_BOUNDED)
+            {
+                for (std::atomic<word_type>& slot : t->_stash._slots)
+                    if (slot.load() != S_EMPTY) this->destroy_entry(to_entry(slot.load()));
+            }
+
+            if constexpr (!S_FIXED) delete t;
+        }
+
+        template< typename... Args >
+        bool emplace(const unsigned& thread_id, Args&&... args)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            entry_type* entry = this->create_entry(std::forward<Args>(args)...);
+
+            const hash_type hash = this->_hash(KeySelect()(entry->value()));
+            entry->set_hash(hash);
+
+            if constexpr (S_FIXED)
+            {
+                // The room is reserved before the kCAS, so concurrent inserts never take the table past its capacity
+                if (this->_reserved.fetch_add(1, Ordering::S_COUNTER) >= S_FIXED_CAPACITY)
+                {
+                    this->_reserved.fetch_sub(1, Ordering::S_COUNTER);
+
+                    const bool exists = this->visit(KeySelect()(entry->value()), hash, thread_id, [](const value_type&) {});
+                    this->destroy_entry(entry);
+
+                    if (exists) return false;
+                    throw std::length_error("fixed capacity table is at its maximum load.");
+                }
+            }
+
+            Backoff backoff;
+            table* t;
+            bool stashed = false;
+            try
+            {
+                for (bool inserted = false; !inserted;)
+                {
+                    t = this->current_table(thread_id);
+
+                    switch (this->try_insert(thread_id, t, entry, hash, true))
+                    {
+                    case probe_result::DONE:
+                        inserted = true;
+                        break;
+                    case probe_result::STASHED:
+                        inserted = stashed = true;
+                        break;
+                    case probe_result::EXISTS:
+                        if constexpr (S_FIXED) this->_reserved.fetch_sub(1, Ordering::S_COUNTER);
+                        this->destroy_entry(entry);
+                        return false;
+                    case probe_result::OVERFLOW:
+                        this->grow(thread_id, t, hash);
+                        break;
+                    case probe_result::MOVED:
+                        this->help_resize(thread_id, t);
+                        break;
+                    default:
+                        backoff();
+                        break;
+                    }
+                }
+            }
+            catch (...)
+            {
+                if constexpr (S_FIXED) this->_reserved.fetch_sub(1, Ordering::S_COUNTER);
+                this->destroy_entry(entry);
+                throw;
+            }
+
+            this->_counters[thread_id]._size.fetch_add(1, Ordering::S_COUNTER);
+            if (stashed) this->maybe_grow_for_stash(thread_id, t);
+            else this->maybe_grow(thread_id, t);
+            return true;
+        }
+
+        template< class K >
+        bool erase(const K& key, const unsigned& thread_id)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            const hash_type hash = this->_hash(key);
+
+            Backoff backoff;
+            for (;;)
+            {
+                table* t = this->current_table(thread_id);
+                entry_type* erased = nullptr;
+
+                switch (this->try_erase(thread_id, t, key, hash, erased))
+                {
+                case probe_result::DONE:
+                    this->_counters[thread_id]._size.fetch_sub(1, Ordering::S_COUNTER);
+                    if constexpr (S_FIXED) this->_reserved.fetch_sub(1, Ordering::S_COUNTER);
+                    pin.retire(record_handle{erased, this, &delete_entry});
+                    this->maybe_shrink(thread_id, t);
+                    return true;
+                case probe_result::ABSENT:
+                    return false;
+                case probe_result::MOVED:
+                    this->help_resize(thread_id, t);
+                    break;
+                default:
+                    backoff();
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Calls a function with the entry holding a
+         * key while the entry is protected from reclamation
+         *
+         * @return true if the key was found
+         */
+        template< class K, class F >
+        bool visit(const K& key, const unsigned& thread_id, F&& f)
+        {
+            return this->visit(key, this->_hash(key), thread_id, std::forward<F>(f));
+        }
+
+        template< class K, class F >
+        bool visit(const K& key, const hash_type& hash, const unsigned& thread_id, F&& f)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            region regions[S_MAX_ENTRIES];
+            std::size_t index, num_regions;
+            word_type word;
+
+            Backoff backoff;
+            for (;;)
+            {
+                table* t = this->current_table(thread_id);
+
+                switch (this->probe(t, key, hash, index, word, regions, num_regions))
+                {
+                case probe_result::DONE:
+                case probe_result::STASHED:
+                    f(static_cast<const value_type&>(to_entry(word)->value()));
+                    return true;
+                case probe_result::ABSENT:
+                    return false;
+                case probe_result::MOVED:
+                    this->help_resize(thread_id, t);
+                    break;
+                default:
+                    backoff();
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Starts a scan split into disjoint cursors, each
+         * covering an equal share of the home regions of the
+         * current table. Cursors for one scan must come from one
+         * call, as shares are only disjoint within a single table
+         *
+         */
+        std::vector<scan_cursor> make_scan_cursors(const unsigned& thread_id, const std::size_t& parts = 1)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            const table* t = this->current_table(thread_id);
+
+            std::vector<scan_cursor> cursors(parts);
+            for (std::size_t part = 0; part < parts; ++part)
+            {
+                const std::size_t first = t->_num_timestamps * part / parts, last = t->_num_timestamps * (part + 1) / parts;
+
+                typename scan_cursor::level level{t->_size, t->_generation, {}, 0, first};
+                if (first != last) level._ranges.emplace_back(first, last);
+                cursors[part]._levels.push_back(std::move(level));
+            }
+
+            return cursors;
+        }
+
+        /**
+         * @brief Reports the entries of the next home region of
+         * a scan. The region is read as one consistent snapshot,
+         * and the function is called with each of its entries while
+         * they are protected from reclamation. Entries inserted or
+         * erased during the scan may or may not be reported; every
+         * other entry is reported exactly once
+         *
+         * @return false once the scan is finished
+         */
+        template< class F >
+        bool scan(scan_cursor& cursor, const unsigned& thread_id, F&& f)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            Backoff backoff;
+            for (;;)
+            {
+                if (cursor.done()) return false;
+
+                table* t = this->current_table(thread_id);
+                typename scan_cursor::level& level = cursor._levels.back();
+
+                if (t->_generation != level._generation)
+                {
+                    typename scan_cursor::level next{t->_size, t->_generation, this->candidate_regions(cursor, t), 0, 0};
+                    if (!next._ranges.empty()) next._region = next._ranges.front().first;
+                    cursor._levels.push_back(std::move(next));
+                    continue;
+                }
+
+                if (!this->scan_region(t, level._region, cursor))
+                {
+                    backoff();
+                    continue;
+                }
+
+                level.advance();
+                for (const entry_type* entry : cursor._entries)
+                    f(static_cast<const value_type&>(entry->value()));
+
+                return true;
+            }
+        }
+
+        /**
+         * @brief Erases the entries of the next home region of a
+         * scan that match a predicate. They are removed together
+         * with one kCAS and retired to the reclaimer as one batch;
+         * only a window too long for a single kCAS falls back to
+         * erasing its matches one key at a time. Consistency is as
+         * for scan
+         *
+         * @return false once the scan is finished
+         */
+        template< class P >
+        bool erase_step(scan_cursor& cursor, const unsigned& thread_id, P&& pred, std::size_t& erased)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            Backoff backoff;
+            for (;;)
+            {
+                if (cursor.done()) return false;
+
+                table* t = this->current_table(thread_id);
+                typename scan_cursor::level& level = cursor._levels.back();
+
+                if (t->_generation != level._generation)
+                {
+                    typename scan_cursor::level next{t->_size, t->_generation, this->candidate_regions(cursor, t), 0, 0};
+                    if (!next._ranges.empty()) next._region = next._ranges.front().first;
+                    cursor._levels.push_back(std::move(next));
+                    continue;
+                }
+
+                switch (this->erase_region(thread_id, t, level._region, cursor, pred))
+                {
+                case probe_result::DONE:
+                {
+                    record_handle handles[S_MAX_ENTRIES];
+                    const std::size_t count = cursor._entries.size();
+
+                    for (std::size_t i = 0; i < count; ++i)
+                        handles[i] = record_handle{cursor._entries[i], this, &delete_entry};
+
+                    if (count != 0)
+                    {
+                        this->_counters[thread_id]._size.fetch_sub(std::ptrdiff_t(count), Ordering::S_COUNTER);
+                        if constexpr (S_FIXED) this->_reserved.fetch_sub(count, Ordering::S_COUNTER);
+                        pin.retire(handles, handles + count);
+                    }
+
+                    erased += count;
+                    level.advance();
+                    return true;
+                }
+                case probe_result::OVERFLOW:
+                {
+                    if (!this->scan_region(t, level._region, cursor))
+                    {
+                        backoff();
+                        break;
+                    }
+
+                    for (entry_type* entry : cursor._entries)
+                    {
+                        const value_type& value = entry->value();
+                        if (pred(value) && this->erase(KeySelect()(value), thread_id)) ++erased;
+                    }
+
+                    level.advance();
+                    return true;
+                }
+                case probe_result::MOVED:
+                    this->help_resize(thread_id, t);
+                    break;
+                default:
+                    backoff();
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Shrinks the table if its load has fallen below
+         * the minimum, as erase does every few calls
+         *
+         */
+        void shrink_if_sparse(const unsigned& thread_id)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            this->shrink_if_sparse(thread_id, this->current_table(thread_id));
+        }
+
+        template< class K >
+        hash_type hash_key(const K& key) const { return this->_hash(key); }
+
+        /**
+         * @brief The table a prefetch aims at. A prefetch is only
+         * a hint, so it does not help a migration, and a table
+         * being replaced is as good a target as any. The caller
+         * pins, since the table may be retired under it otherwise
+         *
+         */
+        const table* prefetch_table() const noexcept
+        {
+            if constexpr (S_FIXED) return &this->_table;
+            else return this->_table.load(Ordering::S_LOAD);
+        }
+
+        /**
+         * @brief Prefetches the home bucket of a hash and
+         * the timestamp guarding it
+         *
+         */
+        void prefetch_bucket(const hash_type& hash, const unsigned& thread_id)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            const table* t = this->prefetch_table();
+            const std::size_t home = this->bucket_for_hash(hash, t);
+
+            ops::prefetch(&t->_buckets[home]);
+            ops::prefetch(&t->_timestamps[home >> S_TIMESTAMP_SHIFT]);
+        }
+
+        /**
+         * @brief Prefetches the entries held by the first buckets
+         * of the probe sequence of a hash, stopping at an empty
+         * bucket. Meant to follow prefetch_bucket once its line
+         * has arrived, under a pin of its own, as the table may
+         * have been replaced in between. Bucket words are read as
+         * they are, without the kCAS, and a word held by a kCAS in
+         * flight only makes a useless prefetch
+         *
+         */
+        void prefetch_entries(const hash_type& hash, const unsigned& thread_id)
+        {
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            const table* t = this->prefetch_table();
+            const std::size_t home = this->bucket_for_hash(hash, t);
+
+            for (std::size_t dist = 0; dist < S_PREFETCH_DISTANCE; ++dist)
+            {
+                const word_type word = t->_buckets[(home + dist) & t->_size_mask].load(std::memory_order_relaxed);
+                if (is_moved(word) || word == S_EMPTY) return;
+
+                ops::prefetch(to_entry(word));
+            }
+        }
+
+        unsigned thread_count() const noexcept { return this->_threads; }
+
+        std::size_t size() const noexcept
+        {
+            std::ptrdiff_t count = 0;
+            for (unsigned i = 0; i < this->_threads; ++i) count += this->_counters[i]._size.load(Ordering::S_COUNTER);
+            return count > 0 ? std::size_t(count) : 0;
+        }
+
+        std::size_t bucket_count() const noexcept
+        {
+            if constexpr (S_FIXED) return Buckets;
+            else return std::size_t(1) << (this->_bucket_count.load(Ordering::S_LOAD) & ((1u << S_BUCKET_COUNT_SHIFT) - 1));
+        }
+    };
 } // namespace crh
 
 #endif // !CONCURRENT_ROBIN_HASH_HPP
\ No newline at end of file
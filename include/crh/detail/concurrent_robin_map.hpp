@@ -2,6 +2,18 @@
 #define CONCURRENT_ROBIN_MAP_HPP
 
 #include "precomp.hpp"
+#include "concurrent_robin_hash.hpp"
+#include "async_lookup.hpp"
+#include "frozen_robin_map.hpp"
+#include "kcas/brown_kcas.hpp"
+#include "../util/trace.hpp"
+
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace crh
 {
@@ -16,83 +28,472 @@ namespace crh
         using key_type = Key;
         using map_type = T;
         using value_type = std::pair<const key_type, map_type>;
-        using hasher = hash::hash<key_type>;
-        using allocator_type = std::allocator<value_type>;
-        using reclaimer = constraints::type_constraint_t<policy::reclaimer_allocator, constraints::unit, Policies...>;
-        using hash = constraints::type_constraint_t<policy::hash, hasher, Policies...>;
-        using map_to_bucket = constraints::type_constraint_t<policy::map_to_bucket, ops::modulo<std::size_t>, Policies...>;
-    
+        using hasher = Hash;
+        using key_equal = std::equal_to<key_type>;
+        using allocator_type = Alloc;
+        using reclaimer = constraints::type_constraint_t<reclamation::reclaimer, constraints::unit, Policies...>;
+        using hash = constraints::type_constraint_t<reclamation::hash, hasher, Policies...>;
+        using map_to_bucket = constraints::type_constraint_t<reclamation::map_to_bucket, ops::modulo<std::size_t>, Policies...>;
+        using backoff = constraints::type_constraint_t<reclamation::backoff, crh::backoff::no_backoff, Policies...>;
+        using ordering = constraints::type_constraint_t<reclamation::ordering, crh::ordering::sequentially_consistent, Policies...>;
+        using kcas = constraints::type_constraint_t<reclamation::kcas, brown_kcas<allocator_type, reclaimer, ordering>, Policies...>;
+        using recorder = constraints::type_constraint_t<reclamation::trace, crh::trace::no_trace, Policies...>;
+
+        static constexpr bool memoize_hash = constraints::value_param_t<bool, reclamation::memoize_hash, false, Policies...>::value;
+        static constexpr std::size_t buckets = constraints::value_param_t<std::size_t, reclamation::buckets, 0, Policies...>::value;
+        static constexpr std::size_t min_load = constraints::value_param_t<std::size_t, reclamation::min_load, 0, Policies...>::value;
+        static constexpr std::size_t max_displacement = constraints::value_param_t<std::size_t, reclamation::max_displacement, 0, Policies...>::value;
+        static constexpr std::uint64_t hash_seed = constraints::value_param_t<std::uint64_t, reclamation::hash_seed, 0, Policies...>::value;
+
+        using frozen_map = frozen_robin_map<key_type, map_type, hash, allocator_type>;
+
         template< class... NewPolicies >
-        using with = concurrent_robin_map<key_type, map_type, allocator_type, NewPolicies..., Policies...>;
-    
+        using with = concurrent_robin_map<key_type, map_type, Hash, allocator_type, NewPolicies..., Policies...>;
+
         static_assert(constraints::is_set<reclaimer>::value, "specify reclaimer policy");
-    
+        static_assert(hash_seed == 0 || std::is_constructible<hash, std::uint64_t>::value, "hash_seed policy needs a hasher that takes a seed");
+
         class iterator;
         class accessor;
-    
+
     private:
-        unsigned _num_timestamps, _size, _size_mask;
-        
-        std::atomic_uint8_t _timestamp_shift;
-        
-        std::unique_ptr<map_to_bucket> _table;
-        
-        reclaimer _reclaimer;
         struct key_select
         {
-            key_type& operator()(const std::pair<key_type, map_type>& key_value) const noexcept
-            {
-                return key_value.first;
-            }
-
-            constexpr
-            key_type& operator()(std::pair<key_type, map_type>& key_value) noexcept
+            const key_type& operator()(const value_type& key_value) const noexcept
             {
                 return key_value.first;
             }
         };
         struct value_select
         {
-            map_type& operator()(const std::pair<key_type, map_type>& key_value) const noexcept
+            const map_type& operator()(const value_type& key_value) const noexcept
             {
                 return key_value.second;
             }
 
-            constexpr
-            map_type& operator()(std::pair<key_type, map_type>& key_value) noexcept
+            map_type& operator()(value_type& key_value) const noexcept
             {
                 return key_value.second;
             }
         };
-    
+
+        using ht = concurrent_robin_hash<value_type, key_select, value_select, hash, key_equal,
+            allocator_type, memoize_hash, kcas, reclaimer, backoff, map_to_bucket, buckets, min_load, ordering, max_displacement>;
+
+        ht _ht;
+
+        recorder _recorder;
+
+        static
+        hash make_hash()
+        {
+            if constexpr (hash_seed != 0) return hash(hash_seed);
+            else return hash();
+        }
+
+        /**
+         * @brief Hands an operation and its outcome to the
+         * recorder, stamped with its start, while a trace is open
+         *
+         */
+        void record(const unsigned& thread_id, const std::uint64_t& timestamp,
+            const crh::trace::op& operation, const key_type& key, const bool& result)
+        {
+            std::uint8_t flags = result ? crh::trace::S_SUCCEEDED : 0;
+            const std::uint64_t bits = crh::trace::encode_key(key,
+                [this](const key_type& k) { return this->_ht.hash_key(k); }, flags);
+
+            this->_recorder.record(thread_id, timestamp, operation, bits, flags);
+        }
+
+        /**
+         * @brief Runs an operation, recording it while a trace
+         * is open
+         *
+         * @return The outcome
+         */
+        template< class F >
+        bool traced(const unsigned& thread_id, const crh::trace::op& operation, const key_type& key, F&& f)
+        {
+            if constexpr (recorder::S_ENABLED)
+            {
+                if (this->_recorder.recording())
+                {
+                    const std::uint64_t timestamp = this->_recorder.timestamp();
+                    const bool result = f();
+
+                    this->record(thread_id, timestamp, operation, key, result);
+                    return result;
+                }
+            }
+            return f();
+        }
+
+        /**
+         * @brief Runs work for every part, the first on the
+         * calling thread and each other on a thread of its own,
+         * and rethrows the first exception once all have finished
+         *
+         */
+        template< class W >
+        void run_parallel(const std::size_t parts, W&& work)
+        {
+            std::exception_ptr error;
+            std::mutex error_mutex;
+
+            auto guarded = [&](const unsigned part)
+            {
+                try
+                {
+                    work(part);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                }
+            };
+
+            std::vector<std::thread> workers;
+            workers.reserve(parts - 1);
+            for (unsigned part = 1; part < parts; ++part) workers.emplace_back(guarded, part);
+
+            guarded(0);
+            for (std::thread& worker : workers) worker.join();
+
+            if (error) std::rethrow_exception(error);
+        }
+
+        /**
+         * @brief Rejects a share of thread ids that runs past those
+         * the map was built for, before any thread touches one
+         *
+         */
+        void check_thread_ids(const unsigned threads, const unsigned first_thread_id) const
+        {
+            if (std::size_t(first_thread_id) + std::max(threads, 1u) > this->_ht.thread_count())
+                throw std::out_of_range("thread ids exceed the thread count of the map.");
+        }
+
     public:
-        concurrent_robin_map(const unsigned& size, 
-            const unsigned& threads) : 
-            _size(size),
-            _size_mask(_size - 1) {}
-        
+        /**
+         * @brief Weakly consistent iterator. It copies out the
+         * entries of one home region at a time and holds no
+         * protection between regions, so it never blocks writers
+         * or resizes. Entries present for the whole iteration are
+         * visited exactly once; those inserted or erased meanwhile
+         * may or may not be. Iterators compare equal only at the end
+         *
+         */
+        class iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = typename concurrent_robin_map::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+
+        private:
+            concurrent_robin_map* _map;
+            unsigned _thread_id;
+            typename ht::scan_cursor _cursor;
+            std::vector<value_type> _values;
+            std::size_t _position;
+
+            friend class concurrent_robin_map;
+
+            iterator(concurrent_robin_map* map, const unsigned& thread_id) :
+                _map(map),
+                _thread_id(thread_id),
+                _cursor(std::move(map->_ht.make_scan_cursors(thread_id).front())),
+                _position(0)
+            {
+                this->fill();
+            }
+
+            void fill()
+            {
+                this->_values.clear();
+                this->_position = 0;
+
+                while (this->_values.empty() && this->_map->_ht.scan(this->_cursor, this->_thread_id,
+                    [this](const value_type& key_value) { this->_values.push_back(key_value); })) {}
+
+                if (this->_values.empty()) this->_map = nullptr;
+            }
+
+        public:
+            iterator() noexcept : _map(nullptr), _thread_id(0), _position(0) {}
+
+            iterator(const iterator&) = default;
+            iterator(iterator&&) noexcept = default;
+
+            iterator &operator=(iterator other) noexcept
+            {
+                std::swap(this->_map, other._map);
+                std::swap(this->_thread_id, other._thread_id);
+                std::swap(this->_cursor, other._cursor);
+                this->_values.swap(other._values);
+                std::swap(this->_position, other._position);
+                return *this;
+            }
+
+            reference operator*() const noexcept { return this->_values[this->_position]; }
+            pointer operator->() const noexcept { return &this->_values[this->_position]; }
+
+            iterator &operator++()
+            {
+                if (++this->_position == this->_values.size()) this->fill();
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator previous(*this);
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator& other) const noexcept
+            {
+                return this == &other || (!this->_map && !other._map);
+            }
+
+            bool operator!=(const iterator& other) const noexcept { return !(*this == other); }
+        };
+
+
+        /**
+         * @brief Constructs a map starting at size buckets. Under
+         * the buckets policy the capacity is fixed instead, and a
+         * size past the entries the fixed table holds throws
+         * std::invalid_argument rather than failing at insert
+         *
+         */
+        concurrent_robin_map(const unsigned& size,
+            const unsigned& threads) :
+            _ht(size, threads, make_hash()),
+            _recorder(threads)
+        {
+            if (buckets != 0 && size > ht::S_FIXED_CAPACITY)
+                throw std::invalid_argument("size exceeds the capacity fixed by the buckets policy.");
+        }
+
+        /**
+         * @brief Constructs a map whose capacity is
+         * fixed by the buckets policy
+         *
+         */
+        explicit
+        concurrent_robin_map(const unsigned& threads) :
+            _ht(buckets, threads, make_hash()),
+            _recorder(threads)
+        {
+            static_assert(buckets != 0, "specify buckets policy or an initial size");
+        }
+
         ~concurrent_robin_map() {}
-    
-        bool emplace(const key_type& key, const unsigned thread_id);
-    
+
+        bool emplace(const key_type& key, const unsigned thread_id)
+        {
+            return this->traced(thread_id, crh::trace::op::INSERT, key, [&] {
+                return this->_ht.emplace(thread_id, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+            });
+        }
+
+        bool insert(const value_type& key_value, const unsigned thread_id)
+        {
+            return this->traced(thread_id, crh::trace::op::INSERT, key_value.first, [&] {
+                return this->_ht.emplace(thread_id, key_value);
+            });
+        }
+
         template< typename... Args >
-        bool emplace(Args&&... args);
-    
+        bool try_emplace(const unsigned thread_id, const key_type& key, Args&&... args)
+        {
+            return this->traced(thread_id, crh::trace::op::INSERT, key, [&] {
+                return this->_ht.emplace(thread_id, std::piecewise_construct, std::forward_as_tuple(key),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+            });
+        }
+
         template< typename... Args >
         std::pair<iterator, bool> emplace_or_get(Args&&... args);
-    
+
         template< typename... Args >
         std::pair<iterator, bool> get_or_emplace(const key_type& key, Args&&... args);
-        
-        bool erase(const key_type& key, const unsigned thread_id);
-        bool contains(const key_type& key);
-        
+
+        bool erase(const key_type& key, const unsigned thread_id)
+        {
+            return this->traced(thread_id, crh::trace::op::ERASE, key, [&] { return this->_ht.erase(key, thread_id); });
+        }
+
+        bool contains(const key_type& key, const unsigned thread_id)
+        {
+            return this->traced(thread_id, crh::trace::op::FIND, key, [&] {
+                return this->_ht.visit(key, thread_id, [](const value_type&) {});
+            });
+        }
+
+        /**
+         * @brief Copies out the value mapped to a key
+         *
+         * @return true if the key was found
+         */
+        bool find(const key_type& key, map_type& value, const unsigned thread_id)
+        {
+            return this->traced(thread_id, crh::trace::op::FIND, key, [&] {
+                return this->_ht.visit(key, thread_id, [&value](const value_type& key_value) { value = value_select()(key_value); });
+            });
+        }
+
+#if CRH_HAS_COROUTINES
+        /**
+         * @brief Looks up a key in steps, prefetching the home
+         * bucket and then the entries it leads to, yielding to the scheduler
+         * after each prefetch, so that lookups from independent
+         * coroutines on one thread overlap their cache misses
+         *
+         * @return The value mapped to the key, if any
+         */
+        async::lookup_task<std::optional<map_type>> async_find(key_type key,
+            const unsigned thread_id,
+            async::interleaving_scheduler& scheduler)
+        {
+            const typename ht::hash_type key_hash = this->_ht.hash_key(key);
+
+            // A lookup is recorded as issued when it starts, before its steps interleave with others
+            std::optional<std::uint64_t> issued;
+            if constexpr (recorder::S_ENABLED)
+            {
+                if (this->_recorder.recording()) issued = this->_recorder.timestamp();
+            }
+
+            this->_ht.prefetch_bucket(key_hash, thread_id);
+            co_await scheduler.yield();
+
+            this->_ht.prefetch_entries(key_hash, thread_id);
+            co_await scheduler.yield();
+
+            std::optional<map_type> value;
+            this->_ht.visit(key, key_hash, thread_id, [&value](const value_type& key_value)
+            {
+                value.emplace(value_select()(key_value));
+            });
+
+            if constexpr (recorder::S_ENABLED)
+            {
+                if (issued) this->record(thread_id, *issued, crh::trace::op::FIND, key, value.has_value());
+            }
+            co_return value;
+        }
+#endif
+
+        std::size_t size() const noexcept { return this->_ht.size(); }
+        std::size_t bucket_count() const noexcept { return this->_ht.bucket_count(); }
+
+        /**
+         * @brief The recorder of the trace policy. Lookups, inserts
+         * and erases by key are recorded with their outcome once it
+         * opens a trace; scans, erase_if and freeze are not
+         *
+         */
+        recorder& trace_recorder() noexcept { return this->_recorder; }
+
+        /**
+         * @brief Starts a weakly consistent iteration. The thread
+         * id is used for every step of the iteration, so the
+         * iterator must stay on the thread that owns that id
+         *
+         */
+        iterator begin(const unsigned thread_id) { return iterator(this, thread_id); }
+        iterator end() const noexcept { return iterator(); }
+
+        /**
+         * @brief Calls a function with every entry, splitting
+         * the home regions of the table evenly across threads.
+         * The calling thread takes the first share under
+         * first_thread_id and each spawned thread the next id, so
+         * those ids must not be in use elsewhere during the call and
+         * must lie below the thread count of the map, or the call
+         * throws std::out_of_range. The function runs concurrently
+         * and must be thread safe; the first exception it throws is
+         * rethrown once every thread has finished. Consistency is
+         * as for iterator
+         *
+         */
+        template< class F >
+        void parallel_for_each(const unsigned threads, const unsigned first_thread_id, F&& fn)
+        {
+            this->check_thread_ids(threads, first_thread_id);
+
+            std::vector<typename ht::scan_cursor> cursors = this->_ht.make_scan_cursors(first_thread_id, std::max(threads, 1u));
+
+            this->run_parallel(cursors.size(), [&](const unsigned part)
+            {
+                while (this->_ht.scan(cursors[part], first_thread_id + part, fn)) {}
+            });
+        }
+
+        /**
+         * @brief Erases every entry matching a predicate, splitting
+         * the home regions of the table evenly across threads as
+         * parallel_for_each does. The matches of each region are
+         * removed with one multi-word operation and retired as one
+         * batch. The predicate runs concurrently, may run more than
+         * once for an entry, and must be thread safe. Entries
+         * inserted during the call may or may not be considered
+         *
+         * @return The number of entries erased
+         */
+        template< class P >
+        std::size_t erase_if(P&& pred, const unsigned threads, const unsigned first_thread_id = 0)
+        {
+            this->check_thread_ids(threads, first_thread_id);
+
+            std::vector<typename ht::scan_cursor> cursors = this->_ht.make_scan_cursors(first_thread_id, std::max(threads, 1u));
+            std::vector<std::size_t> erased(cursors.size(), 0);
+
+            this->run_parallel(cursors.size(), [&](const unsigned part)
+            {
+                std::size_t count = 0;
+                while (this->_ht.erase_step(cursors[part], first_thread_id + part, pred, count)) {}
+                erased[part] = count;
+            });
+
+            this->_ht.shrink_if_sparse(first_thread_id);
+
+            std::size_t total = 0;
+            for (const std::size_t count : erased) total += count;
+            return total;
+        }
+
+        /**
+         * @brief Copies the entries into an immutable map with a
+         * plain, fence-free lookup path. The copy is taken by a
+         * weakly consistent scan, so it is exact only when no other
+         * thread modifies the map meanwhile
+         *
+         */
+        frozen_map freeze(const unsigned thread_id)
+        {
+            std::vector<value_type> values;
+            values.reserve(this->size());
+
+            std::vector<typename ht::scan_cursor> cursors = this->_ht.make_scan_cursors(thread_id);
+            while (this->_ht.scan(cursors.front(), thread_id, [&values](const value_type& key_value)
+            {
+                values.push_back(key_value);
+            })) {}
+
+            return frozen_map(values.begin(), values.end(), make_hash());
+        }
+
         accessor operator[](const key_type& key);
-        
+
         iterator erase(iterator pos);
         iterator find(const key_type& key);
-        iterator begin();
-        iterator end();
 };
 } // namespace crh
 
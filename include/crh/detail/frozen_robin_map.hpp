@@ -0,0 +1,300 @@
+#ifndef CRH_FROZEN_ROBIN_MAP_HPP
+#define CRH_FROZEN_ROBIN_MAP_HPP
+
+#include "precomp.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace crh
+{
+    /**
+     * @brief Immutable robin hood map, built once from a range
+     * of key value pairs or by freezing a concurrent_robin_map.
+     *
+     * The input must be a forward range of pairs whose first member
+     * is the key. Entries are stored inline in the bucket array, next to a
+     * separate array holding one control byte per bucket: zero
+     * for an empty bucket, otherwise the top bit set together with
+     * a seven bit fingerprint of the hash. The table does not wrap
+     * around; entries displaced past the last home bucket spill
+     * into a short tail, so a probe is one contiguous run of
+     * control bytes, matched sixteen at a time where SSE2 is
+     * available. Lookups are plain loads with no timestamps,
+     * descriptors or reclaimer pins, and any number of threads
+     * may read the map concurrently.
+     *
+     * @tparam Key
+     * @tparam T
+     * @tparam Hash
+     * @tparam Alloc
+     */
+    template< class Key,
+              class T,
+              class Hash = hash::hash<Key>,
+              class Alloc = std::allocator<std::pair<const Key, T>> >
+    class frozen_robin_map
+    {
+    public:
+        using key_type = Key;
+        using map_type = T;
+        using value_type = std::pair<const key_type, map_type>;
+        using hasher = Hash;
+        using key_equal = std::equal_to<key_type>;
+        using allocator_type = Alloc;
+        using hash_type = hash::hash_type;
+
+        static constexpr std::size_t S_GROUP = 16;
+        static constexpr std::size_t S_MIN_BUCKETS = 16;
+        static constexpr std::size_t S_MAX_LOAD_NUMERATOR = 7, S_MAX_LOAD_DENOMINATOR = 8;
+        static constexpr std::uint8_t S_EMPTY = 0x0, S_OCCUPIED = 0x80;
+        static constexpr unsigned S_FINGERPRINT_SHIFT = sizeof(hash_type) * 8 - 7;
+
+    private:
+        using value_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+
+        hasher _hash;
+        key_equal _key_equal;
+        value_allocator _allocator;
+
+        std::size_t _size = 0, _size_mask = 0, _max_distance = 0;
+
+        // Home buckets span [0, _size_mask]; the arrays also hold the spill tail
+        std::size_t _length = 0;
+
+        std::vector<std::uint8_t> _control;
+        value_type* _values = nullptr;
+
+        static
+        std::uint8_t control_byte(const hash_type& hash) noexcept
+        {
+            return static_cast<std::uint8_t>(S_OCCUPIED | (hash >> S_FINGERPRINT_SHIFT));
+        }
+
+        /**
+         * @brief Bit mask of the buckets of a group
+         * whose control byte equals a value
+         *
+         */
+        unsigned match(const std::size_t& first, const std::uint8_t& byte) const noexcept
+        {
+        #if __SSE2__
+            const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(this->_control.data() + first));
+            return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(byte)))));
+        #else
+            unsigned mask = 0;
+            for (std::size_t i = 0; i < S_GROUP; ++i)
+                mask |= unsigned(this->_control[first + i] == byte) << i;
+            return mask;
+        #endif
+        }
+
+        void clear() noexcept
+        {
+            if (!this->_values) return;
+
+            for (std::size_t i = 0; i < this->_length; ++i)
+                if (this->_control[i] != S_EMPTY)
+                    std::allocator_traits<value_allocator>::destroy(this->_allocator, this->_values + i);
+
+            std::allocator_traits<value_allocator>::deallocate(this->_allocator, this->_values, this->_length);
+            this->_values = nullptr;
+        }
+
+        // Destroys the values whose control byte is set and frees the array, as clear() does
+        struct values_deleter
+        {
+            frozen_robin_map* _map;
+
+            void operator()(value_type* values) const noexcept
+            {
+                this->_map->_values = values;
+                this->_map->clear();
+            }
+        };
+
+        /**
+         * @brief Lays the input out by robin hood insertion into
+         * a table that does not wrap around, dropping repeated
+         * keys after their first occurrence
+         *
+         */
+        template< class InputIt >
+        void build(InputIt first, InputIt last)
+        {
+            using source_type = std::remove_reference_t<typename std::iterator_traits<InputIt>::reference>;
+
+            std::vector<source_type*> sources;
+            for (; first != last; ++first) sources.push_back(&*first);
+
+            std::size_t buckets = S_MIN_BUCKETS;
+            while (buckets * S_MAX_LOAD_NUMERATOR < sources.size() * S_MAX_LOAD_DENOMINATOR) buckets <<= 1;
+            this->_size_mask = buckets - 1;
+
+            struct placed
+            {
+                std::size_t _source;
+                hash_type _hash;
+            };
+
+            static constexpr std::size_t S_UNUSED = std::size_t(-1);
+
+            std::vector<placed> layout(buckets, placed{S_UNUSED, 0});
+
+            for (std::size_t i = 0; i < sources.size(); ++i)
+            {
+                placed carried{i, this->_hash(sources[i]->first)};
+                std::size_t home = carried._hash & this->_size_mask, pos = home;
+                bool original = true;
+
+                for (;; ++pos)
+                {
+                    if (pos == layout.size()) layout.push_back(placed{S_UNUSED, 0});
+
+                    placed& bucket = layout[pos];
+                    if (bucket._source == S_UNUSED)
+                    {
+                        bucket = carried;
+                        ++this->_size;
+                        break;
+                    }
+
+                    const std::size_t bucket_home = bucket._hash & this->_size_mask;
+
+                    if (original && bucket._hash == carried._hash
+                        && this->_key_equal(sources[bucket._source]->first, sources[carried._source]->first))
+                        break;
+
+                    if (pos - bucket_home < pos - home)
+                    {
+                        std::swap(bucket, carried);
+                        home = bucket_home;
+                        original = false;
+                    }
+                }
+            }
+
+            this->_length = layout.size();
+            this->_control.assign(this->_length + S_GROUP, S_EMPTY);
+
+            // The destructor of a map under construction never runs, so the values are released here if a copy throws
+            std::unique_ptr<value_type, values_deleter> values(
+                std::allocator_traits<value_allocator>::allocate(this->_allocator, this->_length), values_deleter{this});
+
+            for (std::size_t pos = 0; pos < this->_length; ++pos)
+            {
+                const placed& bucket = layout[pos];
+                if (bucket._source == S_UNUSED) continue;
+
+                std::allocator_traits<value_allocator>::construct(this->_allocator, values.get() + pos,
+                    *sources[bucket._source]);
+                this->_control[pos] = control_byte(bucket._hash);
+                this->_max_distance = std::max(this->_max_distance, pos - (bucket._hash & this->_size_mask));
+            }
+
+            this->_values = values.release();
+        }
+
+    public:
+        template< class InputIt >
+        frozen_robin_map(InputIt first, InputIt last,
+            const Hash& hash = Hash(),
+            const Alloc& alloc = Alloc()) :
+            _hash(hash),
+            _allocator(alloc)
+        {
+            this->build(first, last);
+        }
+
+        frozen_robin_map(frozen_robin_map&& other) noexcept :
+            _hash(std::move(other._hash)),
+            _allocator(std::move(other._allocator)),
+            _size(std::exchange(other._size, 0)),
+            _size_mask(other._size_mask),
+            _max_distance(other._max_distance),
+            _length(std::exchange(other._length, 0)),
+            _control(std::move(other._control)),
+            _values(std::exchange(other._values, nullptr)) {}
+
+        frozen_robin_map(const frozen_robin_map&) = delete;
+        frozen_robin_map &operator=(const frozen_robin_map&) = delete;
+
+        frozen_robin_map &operator=(frozen_robin_map&& other) noexcept
+        {
+            if (this == &other) return *this;
+
+            this->clear();
+
+            this->_hash = std::move(other._hash);
+            this->_allocator = std::move(other._allocator);
+            this->_size = std::exchange(other._size, 0);
+            this->_size_mask = other._size_mask;
+            this->_max_distance = other._max_distance;
+            this->_length = std::exchange(other._length, 0);
+            this->_control = std::move(other._control);
+            this->_values = std::exchange(other._values, nullptr);
+
+            return *this;
+        }
+
+        ~frozen_robin_map() { this->clear(); }
+
+        /**
+         * @brief Looks up a key
+         *
+         * @return The entry holding the key, or nullptr
+         */
+        const value_type* find(const key_type& key) const
+        {
+            const hash_type hash = this->_hash(key);
+            const std::uint8_t byte = control_byte(hash);
+            const std::size_t home = hash & this->_size_mask, last = home + this->_max_distance;
+
+            for (std::size_t first = home; first <= last; first += S_GROUP)
+            {
+                for (unsigned mask = this->match(first, byte); mask != 0; mask &= mask - 1)
+                {
+                    const std::size_t pos = first + ops::find_first_bit_set(mask) - 1;
+                    if (pos > last) break;
+
+                    if (this->_key_equal(this->_values[pos].first, key)) return this->_values + pos;
+                }
+
+                if (this->match(first, S_EMPTY) != 0) break;
+            }
+            return nullptr;
+        }
+
+        bool contains(const key_type& key) const { return this->find(key) != nullptr; }
+
+        /**
+         * @brief Copies out the value mapped to a key
+         *
+         * @return true if the key was found
+         */
+        bool find(const key_type& key, map_type& value) const
+        {
+            const value_type* entry = this->find(key);
+            if (entry) value = entry->second;
+            return entry != nullptr;
+        }
+
+        template< class F >
+        void for_each(F&& fn) const
+        {
+            for (std::size_t pos = 0; pos < this->_length; ++pos)
+                if (this->_control[pos] != S_EMPTY) fn(static_cast<const value_type&>(this->_values[pos]));
+        }
+
+        std::size_t size() const noexcept { return this->_size; }
+        std::size_t bucket_count() const noexcept { return this->_length; }
+        std::size_t max_displacement() const noexcept { return this->_max_distance; }
+    };
+} // namespace crh
+
+#endif // !CRH_FROZEN_ROBIN_MAP_HPP
\ No newline at end of file
@@ -1,25 +1,42 @@
 #ifndef CRH_BROWN_KCAS_HPP
 #define CRH_BROWN_KCAS_HPP
 
-#include "harris_kcas.hpp"
+#include "precomp.hpp"
+#include "../../util/policies.hpp"
+
 namespace crh
 {
     /**
-     * @brief Implementation of 
-     * modified kCAS algorithm as presented 
+     * @brief Implementation of
+     * modified kCAS algorithm as presented
      * by Brown and Arbel-Raviv
-     * 
+     *
+     * Every thread owns exactly one kCAS and one RDCSS descriptor
+     * which are reused across operations. Words never point at a
+     * descriptor directly; they hold a tagged pointer naming the
+     * owning thread and the sequence number of the operation, and
+     * helpers validate every field they read against that sequence
+     * number. Descriptors are therefore never retired, and the
+     * memory reclaimer is not needed.
+     *
+     * Words taking part in a kCAS must keep their two lowest bits
+     * clear, and at most S_MAX_ENTRIES words may be swapped at once.
+     *
      * @tparam Allocator An allocator policy
      * @tparam MemReclaimer A memory reclaimer policy
+     * @tparam Ordering A memory ordering policy
      */
     template< class Allocator,
-              class MemReclaimer >
+              class MemReclaimer,
+              class Ordering = ordering::sequentially_consistent >
     class brown_kcas
     {
     public:
         using alloc_type = typename std::size_t;
         using state_type = typename std::uintptr_t;
-        
+        using entry_type = kcas_entry<state_type>;
+        using ordering_type = Ordering;
+
         enum class tag_type
         {
             NONE,
@@ -30,48 +47,55 @@ namespace crh
         static constexpr alloc_type S_NO_TAG = 0x0, S_KCAS_TAG = 0x1, S_RDCSS_TAG = 0x2;
         static constexpr alloc_type S_THREAD_ID_SHIFT = 2, S_THREAD_ID_MASK = (1 << 8) - 1;
         static constexpr alloc_type S_SEQUENCE_SHIFT = 10, S_SEQUENCE_MASK = (alloc_type(1) << 54) - 1;
-        
+        static constexpr alloc_type S_RESERVED_BITS = S_KCAS_TAG | S_RDCSS_TAG;
+        static constexpr alloc_type S_MAX_ENTRIES = 128;
+
         static constexpr state_type UNDECIDED = 0, SUCCESS = 1, FAILED = 2;
-        
+
     private:
         /**
          * @brief A class representing the
          * status of a given descriptor for
-         * kCAS
-         * 
+         * kCAS, packed into a single word
+         *
          */
         class k_cas_descriptor_status
         {
         private:
-            state_type _sequence_number, _status;
-            
+            state_type _bits;
+
         public:
             inline
             explicit
-            k_cas_descriptor_status() :
-                _status(UNDECIDED),
-                _sequence_number(0) {}
-            
+            k_cas_descriptor_status(const state_type& bits) :
+                _bits(bits) {}
+
             inline
             explicit
-            k_cas_descriptor_status(const state_type& status, 
+            k_cas_descriptor_status(const state_type& status,
                 const state_type& sequence_number) :
-                _status(status), 
-                _sequence_number(sequence_number) {}
+                _bits(((sequence_number & S_SEQUENCE_MASK) << 2) | status) {}
+
+            inline
+            state_type bits() const noexcept { return this->_bits; }
 
-            ~k_cas_descriptor_status() {}
+            inline
+            state_type status() const noexcept { return this->_bits & 0x3; }
+
+            inline
+            state_type sequence_number() const noexcept { return this->_bits >> 2; }
         };
 
         /**
          * @brief A pointer with additional associated
          * data, in this case a raw bit count
-         * 
+         *
          */
         class tagged_pointer
         {
         private:
             state_type _raw_bits;
-        
+
         public:
             inline
             explicit
@@ -79,24 +103,36 @@ namespace crh
 
             inline
             explicit
-            tagged_pointer(const state_type& raw_bits) : 
-                _raw_bits(raw_bits)
-            {
-                static_assert(is_bits(*this));
-            }
+            tagged_pointer(const state_type& raw_bits) :
+                _raw_bits(raw_bits) {}
 
             explicit
-            tagged_pointer(const state_type& tag_bits, 
+            tagged_pointer(const state_type& tag_bits,
                 const state_type& thread_id,
-                const state_type& sequence_number) : 
-                _raw_bits(tag_bits | (thread_id << S_THREAD_ID_SHIFT) 
-                    | (sequence_number << S_SEQUENCE_SHIFT)) {}
+                const state_type& sequence_number) :
+                _raw_bits(tag_bits | (thread_id << S_THREAD_ID_SHIFT)
+                    | ((sequence_number & S_SEQUENCE_MASK) << S_SEQUENCE_SHIFT)) {}
 
             tagged_pointer(const tagged_pointer&) = default;
             tagged_pointer &operator=(const tagged_pointer&) = default;
 
             ~tagged_pointer() {}
-            
+
+            inline
+            state_type bits() const noexcept { return this->_raw_bits; }
+
+            inline
+            unsigned thread_id() const noexcept
+            {
+                return (this->_raw_bits >> S_THREAD_ID_SHIFT) & S_THREAD_ID_MASK;
+            }
+
+            inline
+            state_type sequence_number() const noexcept
+            {
+                return (this->_raw_bits >> S_SEQUENCE_SHIFT) & S_SEQUENCE_MASK;
+            }
+
             static
             inline
             constexpr
@@ -121,6 +157,327 @@ namespace crh
                 return !(is_kcas(tag_ptr) || is_rdcss(tag_ptr));
             }
         };
+
+        struct descriptor_entry
+        {
+            std::atomic<std::atomic<state_type>*> _addr;
+            std::atomic<state_type> _old_val, _new_val;
+        };
+
+        /**
+         * @brief Per-thread kCAS descriptor. The
+         * status word holds the sequence number of the
+         * operation currently described
+         *
+         */
+        struct alignas(128) k_cas_descriptor
+        {
+            std::atomic<state_type> _status{0};
+            std::atomic<alloc_type> _size{0};
+
+            descriptor_entry _entries[S_MAX_ENTRIES];
+        };
+
+        /**
+         * @brief Per-thread restricted double compare
+         * single swap descriptor. The control word is the
+         * status of the kCAS named by the new value
+         *
+         */
+        struct alignas(128) rdcss_descriptor
+        {
+            std::atomic<state_type> _sequence_number{0};
+            std::atomic<std::atomic<state_type>*> _data_address{nullptr};
+            std::atomic<state_type> _expected_d_value{0}, _new_w_value{0};
+        };
+
+        using k_cas_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<k_cas_descriptor>;
+        using rdcss_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<rdcss_descriptor>;
+
+        unsigned _threads;
+
+        k_cas_allocator _k_cas_allocator;
+        rdcss_allocator _rdcss_allocator;
+
+        k_cas_descriptor* _k_cas_descriptors;
+        rdcss_descriptor* _rdcss_descriptors;
+
+#ifdef CRH_KCAS_STATS
+        kcas_statistics _statistics;
+#endif
+
+        /**
+         * @brief Copies the entries of the kCAS named by
+         * a tagged pointer, failing if the descriptor has
+         * moved on to a later operation
+         *
+         */
+        bool snapshot(const tagged_pointer& ptr, entry_type* entries, alloc_type& size) const noexcept
+        {
+            const k_cas_descriptor& desc = this->_k_cas_descriptors[ptr.thread_id()];
+
+            if (k_cas_descriptor_status(desc._status.load(Ordering::S_LOAD)).sequence_number() != ptr.sequence_number())
+                return false;
+
+            size = std::min(desc._size.load(Ordering::S_LOAD), S_MAX_ENTRIES);
+            for (alloc_type i = 0; i < size; ++i)
+            {
+                entries[i] = entry_type{desc._entries[i]._addr.load(Ordering::S_LOAD),
+                                        desc._entries[i]._old_val.load(Ordering::S_LOAD),
+                                        desc._entries[i]._new_val.load(Ordering::S_LOAD)};
+            }
+
+            return k_cas_descriptor_status(desc._status.load(Ordering::S_LOAD)).sequence_number() == ptr.sequence_number();
+        }
+
+        void help_rdcss(const tagged_pointer& ptr) noexcept
+        {
+            const rdcss_descriptor& desc = this->_rdcss_descriptors[ptr.thread_id()];
+
+            std::atomic<state_type>* data_address = desc._data_address.load(Ordering::S_LOAD);
+            const state_type expected = desc._expected_d_value.load(Ordering::S_LOAD);
+            const tagged_pointer k_cas_ptr(desc._new_w_value.load(Ordering::S_LOAD));
+
+            if (desc._sequence_number.load(Ordering::S_LOAD) != ptr.sequence_number()) return;
+
+            const k_cas_descriptor_status control(
+                this->_k_cas_descriptors[k_cas_ptr.thread_id()]._status.load(Ordering::S_LOAD));
+
+            const bool undecided = control.sequence_number() == k_cas_ptr.sequence_number()
+                && control.status() == UNDECIDED;
+
+            state_type installed = ptr.bits();
+            data_address->compare_exchange_strong(installed, undecided ? k_cas_ptr.bits() : expected,
+                Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE);
+        }
+
+        state_type rdcss(const unsigned& thread_id,
+            std::atomic<state_type>* data_address,
+            const state_type& expected,
+            const tagged_pointer& k_cas_ptr) noexcept
+        {
+            rdcss_descriptor& desc = this->_rdcss_descriptors[thread_id];
+
+            const state_type sequence_number = (desc._sequence_number.load(Ordering::S_LOAD) + 1) & S_SEQUENCE_MASK;
+            desc._sequence_number.store(sequence_number, Ordering::S_STORE);
+            desc._data_address.store(data_address, Ordering::S_STORE);
+            desc._expected_d_value.store(expected, Ordering::S_STORE);
+            desc._new_w_value.store(k_cas_ptr.bits(), Ordering::S_STORE);
+
+            const tagged_pointer ptr(S_RDCSS_TAG, thread_id, sequence_number);
+
+            for (;;)
+            {
+                state_type observed = expected;
+                if (data_address->compare_exchange_strong(observed, ptr.bits(), Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE))
+                {
+                    this->help_rdcss(ptr);
+                    return expected;
+                }
+
+                if (!tagged_pointer::is_rdcss(tagged_pointer(observed))) return observed;
+
+                this->help_rdcss(tagged_pointer(observed));
+            }
+        }
+
+        bool help(const unsigned& thread_id, const tagged_pointer& ptr) noexcept
+        {
+            entry_type entries[S_MAX_ENTRIES];
+            alloc_type size;
+
+            if (!this->snapshot(ptr, entries, size)) return false;
+
+            std::atomic<state_type>& status = this->_k_cas_descriptors[ptr.thread_id()]._status;
+
+            const k_cas_descriptor_status undecided(UNDECIDED, ptr.sequence_number());
+
+            if (status.load(Ordering::S_LOAD) == undecided.bits())
+            {
+                state_type outcome = SUCCESS;
+                for (alloc_type i = 0; i < size && outcome == SUCCESS; ++i)
+                {
+                    for (;;)
+                    {
+                        const state_type observed = this->rdcss(thread_id, entries[i]._addr, entries[i]._old_val, ptr);
+
+                        if (tagged_pointer::is_kcas(tagged_pointer(observed)))
+                        {
+                            if (observed == ptr.bits()) break;
+
+#ifdef CRH_KCAS_STATS
+                            this->_statistics.helped(thread_id);
+#endif
+                            this->help(thread_id, tagged_pointer(observed));
+                            continue;
+                        }
+
+                        if (observed != entries[i]._old_val) outcome = FAILED;
+                        break;
+                    }
+                }
+
+                state_type expected = undecided.bits();
+                status.compare_exchange_strong(expected, k_cas_descriptor_status(outcome, ptr.sequence_number()).bits(),
+                    Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE);
+            }
+
+            const k_cas_descriptor_status decided(status.load(Ordering::S_LOAD));
+            if (decided.sequence_number() != ptr.sequence_number()) return false;
+
+            const bool succeeded = decided.status() == SUCCESS;
+            for (alloc_type i = 0; i < size; ++i)
+            {
+                state_type installed = ptr.bits();
+                entries[i]._addr->compare_exchange_strong(installed,
+                    succeeded ? entries[i]._new_val : entries[i]._old_val,
+                    Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE);
+            }
+
+            return succeeded;
+        }
+
+        /**
+         * @brief Rejects more threads than a tagged pointer
+         * has room to name, which would alias descriptors
+         *
+         */
+        static
+        unsigned checked_thread_count(const unsigned& threads)
+        {
+            if (threads > S_THREAD_ID_MASK + 1)
+                throw std::invalid_argument("thread count exceeds the thread ids a kCAS descriptor can name.");
+            return threads;
+        }
+
+    public:
+        explicit
+        brown_kcas(const unsigned& threads, MemReclaimer&) :
+            _threads(checked_thread_count(threads)),
+            _k_cas_descriptors(std::allocator_traits<k_cas_allocator>::allocate(_k_cas_allocator, threads)),
+            _rdcss_descriptors(std::allocator_traits<rdcss_allocator>::allocate(_rdcss_allocator, threads))
+#ifdef CRH_KCAS_STATS
+            , _statistics(threads)
+#endif
+        {
+            for (unsigned i = 0; i < threads; ++i)
+            {
+                std::allocator_traits<k_cas_allocator>::construct(this->_k_cas_allocator, this->_k_cas_descriptors + i);
+                std::allocator_traits<rdcss_allocator>::construct(this->_rdcss_allocator, this->_rdcss_descriptors + i);
+            }
+        }
+
+        brown_kcas(const brown_kcas&) = delete;
+        brown_kcas &operator=(const brown_kcas&) = delete;
+
+        ~brown_kcas()
+        {
+            for (unsigned i = 0; i < this->_threads; ++i)
+            {
+                std::allocator_traits<k_cas_allocator>::destroy(this->_k_cas_allocator, this->_k_cas_descriptors + i);
+                std::allocator_traits<rdcss_allocator>::destroy(this->_rdcss_allocator, this->_rdcss_descriptors + i);
+            }
+            std::allocator_traits<k_cas_allocator>::deallocate(this->_k_cas_allocator, this->_k_cas_descriptors, this->_threads);
+            std::allocator_traits<rdcss_allocator>::deallocate(this->_rdcss_allocator, this->_rdcss_descriptors, this->_threads);
+        }
+
+        /**
+         * @brief Reads the logical value of a word. Words
+         * holding a descriptor resolve to the value the
+         * descriptor will leave behind, without helping.
+         * A descriptor found by a relaxed load is only
+         * followed after loading the word again with acquire
+         *
+         * @param addr The word to be read
+         * @param order The memory order of the load
+         * @return state_type The logical value of the word
+         */
+        state_type read(const std::atomic<state_type>& addr,
+            const std::memory_order order = Ordering::S_LOAD) const noexcept
+        {
+            for (;;)
+            {
+                state_type value = addr.load(order);
+                if (order == std::memory_order_relaxed && !tagged_pointer::is_bits(tagged_pointer(value)))
+                    value = addr.load(std::memory_order_acquire);
+
+                const tagged_pointer ptr(value);
+
+                if (tagged_pointer::is_bits(ptr)) return value;
+
+                if (tagged_pointer::is_rdcss(ptr))
+                {
+                    const rdcss_descriptor& desc = this->_rdcss_descriptors[ptr.thread_id()];
+                    const state_type expected = desc._expected_d_value.load(Ordering::S_LOAD);
+
+                    if (desc._sequence_number.load(Ordering::S_LOAD) == ptr.sequence_number()) return expected;
+                    continue;
+                }
+
+                const k_cas_descriptor& desc = this->_k_cas_descriptors[ptr.thread_id()];
+                const alloc_type size = std::min(desc._size.load(Ordering::S_LOAD), S_MAX_ENTRIES);
+
+                state_type old_val = 0, new_val = 0;
+                for (alloc_type i = 0; i < size; ++i)
+                {
+                    if (desc._entries[i]._addr.load(Ordering::S_LOAD) == &addr)
+                    {
+                        old_val = desc._entries[i]._old_val.load(Ordering::S_LOAD);
+                        new_val = desc._entries[i]._new_val.load(Ordering::S_LOAD);
+                        break;
+                    }
+                }
+
+                const k_cas_descriptor_status status(desc._status.load(Ordering::S_LOAD));
+                if (status.sequence_number() != ptr.sequence_number()) continue;
+
+                return status.status() == SUCCESS ? new_val : old_val;
+            }
+        }
+
+        /**
+         * @brief Multi-word compare and swap method
+         *
+         * @param thread_id The calling thread
+         * @param first The first word to be swapped
+         * @param last One past the last word to be swapped
+         * @return true if every word held its old value
+         * and now holds its new one
+         * @return false if any word differed, in which
+         * case no word was modified
+         */
+        bool cas(const unsigned& thread_id, entry_type* first, entry_type* last) noexcept
+        {
+            const alloc_type size = last - first;
+            assert(size <= S_MAX_ENTRIES);
+
+            sort_kcas_entries(first, last);
+
+            k_cas_descriptor& desc = this->_k_cas_descriptors[thread_id];
+
+            const state_type sequence_number =
+                (k_cas_descriptor_status(desc._status.load(Ordering::S_LOAD)).sequence_number() + 1) & S_SEQUENCE_MASK;
+
+            desc._status.store(k_cas_descriptor_status(UNDECIDED, sequence_number).bits(), Ordering::S_STORE);
+            desc._size.store(size, Ordering::S_STORE);
+            for (alloc_type i = 0; i < size; ++i)
+            {
+                desc._entries[i]._addr.store(first[i]._addr, Ordering::S_STORE);
+                desc._entries[i]._old_val.store(first[i]._old_val, Ordering::S_STORE);
+                desc._entries[i]._new_val.store(first[i]._new_val, Ordering::S_STORE);
+            }
+
+            return this->help(thread_id, tagged_pointer(S_KCAS_TAG, thread_id, sequence_number));
+        }
+
+#ifdef CRH_KCAS_STATS
+        /**
+         * @brief Operations of other threads helped to
+         * completion by a thread
+         *
+         */
+        std::size_t helps(const unsigned& thread_id) const noexcept { return this->_statistics.helps(thread_id); }
+#endif
     };
 } // namespace crh
 
@@ -2,314 +2,311 @@
 #define CRH_HARRIS_KCAS_HPP
 
 #include "precomp.hpp"
+#include "../../util/policies.hpp"
 
 namespace crh
 {
     /**
      * @brief Implementation of original kCAS
-     * 
-     * @tparam Allocator 
-     * @tparam MemReclaimer 
+     * algorithm as presented by Harris, Fraser
+     * and Pratt
+     *
+     * Every operation allocates a fresh kCAS descriptor, and every
+     * word it acquires a fresh RDCSS descriptor; words point at
+     * them directly. Descriptors are retired to the memory
+     * reclaimer once their owner is done with them, so read() must
+     * be called while the caller is pinned.
+     *
+     * Words taking part in a kCAS must keep their two lowest bits
+     * clear, and at most S_MAX_ENTRIES words may be swapped at once.
+     *
+     * @tparam Allocator An allocator policy
+     * @tparam MemReclaimer A memory reclaimer policy
+     * @tparam Ordering A memory ordering policy
      */
     template< class Allocator,
-              class MemReclaimer >
+              class MemReclaimer,
+              class Ordering = ordering::sequentially_consistent >
     class harris_kcas
     {
     public:
         using alloc_type = typename std::size_t;
         using state_type = typename std::uintptr_t;
+        using entry_type = kcas_entry<state_type>;
+        using ordering_type = Ordering;
+        using record_handle = typename MemReclaimer::record_handle;
+
+        static constexpr alloc_type S_NO_TAG = 0x0, S_KCAS_TAG = 0x1, S_RDCSS_TAG = 0x2;
+        static constexpr alloc_type S_RESERVED_BITS = S_KCAS_TAG | S_RDCSS_TAG;
+        static constexpr alloc_type S_MAX_ENTRIES = 128;
 
-        static constexpr alloc_type S_KCAS_BIT = 0x1, S_RDCSS_BIT = 0x2;
-        
         static constexpr state_type UNDECIDED = 0, SUCCESS = 1, FAILED = 2;
 
     private:
         /**
-         * @brief General descriptor control for the restricted double
-         * compare and single swap method
-         * 
-         * @tparam WordType A word of specified bit size
-         * @tparam AddrType A control or data address
+         * @brief Descriptor of one kCAS. Only the
+         * status changes once it is published
+         *
          */
-        template< class WordType,
-                  class AddrType >
-        class rdcss_descriptor
+        struct alignas(8) k_cas_descriptor
         {
-        private:
-            const WordType _expected_c_value, _expected_d_value, _new_w_value;
-            
-            std::atomic<bool> is_desc;
-            
-            std::unique_ptr<AddrType> _control_address, _data_address;
-
-        public:
-            inline
-            rdcss_descriptor() : is_desc(true) {}
-
-            explicit
-            rdcss_descriptor(const AddrType& control_address,
-                const AddrType& data_address) :
-                _control_address(std::make_unique<AddrType>(control_address)),
-                _data_address(std::make_unique<AddrType>(data_address)) {}
-
-            rdcss_descriptor(const rdcss_descriptor&) = default;
-            rdcss_descriptor &operator=(const rdcss_descriptor&) = default;
-
-            ~rdcss_descriptor() {}
-
-            /**
-             * @brief A simple, single word atomic 
-             * compare-and-swap method
-             * 
-             * @param a The word to be modified
-             * @param o The expected old value
-             * @param n The value to be assigned
-             * @return WordType A word of specified bit size
-             */
-            static
-            inline
-            constexpr
-            WordType cas_1(WordType a, WordType o, WordType n) noexcept
-            {
-                std::unique_ptr<WordType> a_ptr = std::make_unique<WordType>(a);
-                
-                WordType old = a_ptr.release();
-                
-                if (old == o) a_ptr = std::make_unique<WordType>(n);
-                
-                return old;
-            }
+            std::atomic<state_type> _status{UNDECIDED};
+            alloc_type _size;
 
-            /**
-             * @brief The restricted double compare
-             * single swap method
-             * 
-             * @param desc An descriptor representing the
-             * expected and new control and data addresses 
-             * and values
-             * @return WordType A word of specified bit size
-             */
-            static
-            constexpr
-            WordType rdcss(const rdcss_descriptor& desc) noexcept
-            {
-                WordType r;
+            entry_type* _entries;
+        };
 
-                do
-                {
-                    r = cas_1(desc._data_address, desc._expected_d_value, desc);
-                } while(is_descriptor(desc));
-                
-                if (r == desc._expected_d_value) complete(desc);
-                
-                return r;
-            }
+        /**
+         * @brief Restricted double compare single swap
+         * descriptor. The control word is the status of
+         * the kCAS installed as the new value
+         *
+         */
+        struct alignas(8) rdcss_descriptor
+        {
+            const std::atomic<state_type>* _control_address;
+            std::atomic<state_type>* _data_address;
 
-            static
-            constexpr
-            WordType read(AddrType addr) noexcept
-            {
-                std::unique_ptr<AddrType> addr_ptr = std::make_unique<AddrType>(addr);
+            state_type _expected_d_value, _new_w_value;
+        };
 
-                WordType r;
-                do
-                {
-                    r = std::atomic_load<AddrType>(addr_ptr.release());
-                    if (is_descriptor(r)) complete(r);
-                } while(is_descriptor(r));
-                
-                return r;
-            }
+        using k_cas_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<k_cas_descriptor>;
+        using rdcss_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<rdcss_descriptor>;
+        using entry_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<entry_type>;
 
-            static
-            inline
-            constexpr
-            void complete(const rdcss_descriptor& desc) noexcept
-            {
-                WordType v = std::atomic_load<WordType>(desc._control_address.get());
-                
-                if (v == desc._expected_c_value)
-                    cas_1(desc._data_address, desc, desc._new_w_value);
-                else
-                    cas_1(desc._data_address, desc, desc._expected_d_value);
-            }
+        MemReclaimer& _reclaimer;
 
-            static
-            inline
-            constexpr
-            bool is_descriptor(const rdcss_descriptor& desc) noexcept
-            {
-                return desc.is_desc;
-            }
-        };
+        k_cas_allocator _k_cas_allocator;
+        rdcss_allocator _rdcss_allocator;
+        entry_allocator _entry_allocator;
 
-        enum class k_cas_descriptor_status
-        {
-            UNDECIDED,
-            SUCCESS,
-            FAILED
-        };
-        
-        template< typename WordType,
-                  typename AddrType >
-        union descriptor_union
+#ifdef CRH_KCAS_STATS
+        kcas_statistics _statistics;
+#endif
+
+        static
+        bool is_kcas(const state_type& word) noexcept { return (word & S_KCAS_TAG) == S_KCAS_TAG; }
+
+        static
+        bool is_rdcss(const state_type& word) noexcept { return (word & S_RDCSS_TAG) == S_RDCSS_TAG; }
+
+        static
+        k_cas_descriptor* to_k_cas(const state_type& word) noexcept
         {
-        public:
-            using rdcss_descriptor = typename harris_kcas<Allocator, MemReclaimer>
-                ::rdcss_descriptor<WordType, AddrType>;
-        
-        private:
-            state_type _bits;
-
-            WordType _val;
-
-            std::unique_ptr<rdcss_descriptor> _descriptor;
-
-        public:
-            inline
-            descriptor_union() : _bits(0) {}
-
-            inline
-            explicit
-            descriptor_union(const state_type& bits) : _bits(bits) {}
-
-            inline
-            explicit
-            descriptor_union(const WordType& val) : _val(val) {}
-            
-            explicit
-            descriptor_union(const rdcss_descriptor& desc) :
-                _descriptor(std::make_unique<rdcss_descriptor>(desc))
-            {
-                static_assert(is_rdcss(*this));
-            }
+            return reinterpret_cast<k_cas_descriptor*>(word & ~S_RESERVED_BITS);
+        }
 
-            descriptor_union(const descriptor_union&) = default;
-            descriptor_union &operator=(const descriptor_union&) = default;
+        static
+        rdcss_descriptor* to_rdcss(const state_type& word) noexcept
+        {
+            return reinterpret_cast<rdcss_descriptor*>(word & ~S_RESERVED_BITS);
+        }
 
-            ~descriptor_union() {}
+        static
+        void delete_k_cas(void* context, void* ptr) noexcept
+        {
+            harris_kcas* self = static_cast<harris_kcas*>(context);
+            k_cas_descriptor* desc = static_cast<k_cas_descriptor*>(ptr);
 
-            static
-            inline
-            constexpr
-            bool is_rdcss(const descriptor_union& desc) noexcept
-            {
-                return (desc._bits & S_RDCSS_BIT) == S_RDCSS_BIT;
-            }
+            std::allocator_traits<entry_allocator>::deallocate(self->_entry_allocator, desc->_entries, desc->_size);
+            std::allocator_traits<k_cas_allocator>::destroy(self->_k_cas_allocator, desc);
+            std::allocator_traits<k_cas_allocator>::deallocate(self->_k_cas_allocator, desc, 1);
+        }
 
-            static
-            inline
-            constexpr
-            bool is_kcas(const descriptor_union& desc) noexcept
-            {
-                return (desc._bits & S_KCAS_BIT) == S_KCAS_BIT;
-            }
-        };
-        
-        template< typename WordType,
-                  typename AddrType >
-        class entry_payload
+        static
+        void delete_rdcss(void* context, void* ptr) noexcept
         {
-        public:
-            using data_loc_type = typename harris_kcas<Allocator, MemReclaimer>
-                ::descriptor_union<WordType, AddrType>;
+            harris_kcas* self = static_cast<harris_kcas*>(context);
+            rdcss_descriptor* desc = static_cast<rdcss_descriptor*>(ptr);
 
-        private:
-            AddrType _addr;
+            std::allocator_traits<rdcss_allocator>::destroy(self->_rdcss_allocator, desc);
+            std::allocator_traits<rdcss_allocator>::deallocate(self->_rdcss_allocator, desc, 1);
+        }
 
-            data_loc_type _old_val, _new_val;
+        void complete(const rdcss_descriptor* desc) noexcept
+        {
+            const bool undecided = desc->_control_address->load(Ordering::S_LOAD) == UNDECIDED;
+
+            state_type installed = reinterpret_cast<state_type>(desc) | S_RDCSS_TAG;
+            desc->_data_address->compare_exchange_strong(installed,
+                undecided ? desc->_new_w_value : desc->_expected_d_value,
+                Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE);
+        }
+
+        state_type rdcss(const unsigned& thread_id,
+            const std::atomic<state_type>* control_address,
+            std::atomic<state_type>* data_address,
+            const state_type& expected,
+            const state_type& k_cas_word)
+        {
+            rdcss_descriptor* desc = std::allocator_traits<rdcss_allocator>::allocate(this->_rdcss_allocator, 1);
+            std::allocator_traits<rdcss_allocator>::construct(this->_rdcss_allocator, desc);
 
-            std::unique_ptr<data_loc_type> _data_location;
+            desc->_control_address = control_address;
+            desc->_data_address = data_address;
+            desc->_expected_d_value = expected;
+            desc->_new_w_value = k_cas_word;
 
-        public:
-            entry_payload() :
-                _old_val(data_loc_type()),
-                _new_val(data_loc_type()),
-                _data_location(std::make_unique<data_loc_type>()) {}
+            const state_type word = reinterpret_cast<state_type>(desc) | S_RDCSS_TAG;
 
-            explicit
-            entry_payload(const WordType& old_val,
-                const WordType& new_val) :
-                _old_val(data_loc_type(old_val)),
-                _new_val(data_loc_type(new_val)),
-                _data_location(std::make_unique<data_loc_type>()) {}
+            for (;;)
+            {
+                state_type observed = expected;
+                if (data_address->compare_exchange_strong(observed, word, Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE))
+                {
+                    this->complete(desc);
+                    this->_reclaimer.template retire<Ordering>(thread_id, record_handle{desc, this, &delete_rdcss});
+                    return expected;
+                }
 
-            entry_payload(const entry_payload&) = default;
-            entry_payload &operator=(const entry_payload&) = default;
+                if (!is_rdcss(observed))
+                {
+                    // Never published, so nobody else can hold it
+                    delete_rdcss(this, desc);
+                    return observed;
+                }
 
-            ~entry_payload() {}
-        };
-        
-        template< typename WordType,
-                  typename AddrType >
-        class k_cas_descriptor
+                this->complete(to_rdcss(observed));
+            }
+        }
+
+        bool help(const unsigned& thread_id, k_cas_descriptor* desc)
         {
-        public:
-            using entry_t = typename harris_kcas<Allocator, MemReclaimer>
-                ::entry_payload<WordType, AddrType>;
-
-            using status_t = typename std::atomic<k_cas_descriptor_status>;
-
-        private:
-            const unsigned _n = 445;
-            
-            entry_t _entry;
-            status_t _descriptor_status;
-
-            std::atomic<bool> is_desc = {true};
-
-        public:
-            k_cas_descriptor() :
-                _entry(entry_t()),
-                _descriptor_status(status_t(UNDECIDED)) {}
-            
-            k_cas_descriptor(const status_t& desc_status) :
-                _entry(entry_t()),
-                _descriptor_status(desc_status) {}
-
-            k_cas_descriptor(const WordType& old_val, const WordType& new_val) :
-                _entry(entry_t(old_val, new_val)),
-                _descriptor_status(status_t(UNDECIDED)) {}
-            
-            k_cas_descriptor(const k_cas_descriptor&) = default;
-            k_cas_descriptor &operator=(const k_cas_descriptor_status&) = default;
-
-            ~k_cas_descriptor() {}
-
-            /**
-             * @brief Multi-word compare and swap method
-             * 
-             * @param desc A kCAS descriptor
-             * @return true 
-             * @return false 
-             */
-            inline
-            bool kcas(const k_cas_descriptor& desc) const noexcept
+            const state_type word = reinterpret_cast<state_type>(desc) | S_KCAS_TAG;
+
+            if (desc->_status.load(Ordering::S_LOAD) == UNDECIDED)
             {
-                if (std::atomic_load<WordType>(desc._descriptor_status) == UNDECIDED)
+                state_type outcome = SUCCESS;
+                for (alloc_type i = 0; i < desc->_size && outcome == SUCCESS; ++i)
                 {
-                    this->_descriptor_status = SUCCESS;
-                    for (unsigned i = 0; i < desc._n; ++i)
+                    const entry_type& entry = desc->_entries[i];
+
+                    for (;;)
                     {
-                        this->_entry = desc._entry;
+                        const state_type observed = this->rdcss(thread_id, &desc->_status, entry._addr, entry._old_val, word);
+
+                        if (is_kcas(observed))
+                        {
+                            if (observed == word) break;
+
+#ifdef CRH_KCAS_STATS
+                            this->_statistics.helped(thread_id);
+#endif
+                            this->help(thread_id, to_k_cas(observed));
+                            continue;
+                        }
+
+                        if (observed != entry._old_val) outcome = FAILED;
+                        break;
                     }
                 }
+
+                state_type expected = UNDECIDED;
+                desc->_status.compare_exchange_strong(expected, outcome,
+                Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE);
             }
 
-            inline
-            bool is_descriptor(const k_cas_descriptor& desc) const noexcept
+            const bool succeeded = desc->_status.load(Ordering::S_LOAD) == SUCCESS;
+            for (alloc_type i = 0; i < desc->_size; ++i)
             {
-                return desc.is_desc;
+                state_type installed = word;
+                desc->_entries[i]._addr->compare_exchange_strong(installed,
+                    succeeded ? desc->_entries[i]._new_val : desc->_entries[i]._old_val,
+                    Ordering::S_UPDATE, Ordering::S_UPDATE_FAILURE);
             }
-        };
-    
+
+            return succeeded;
+        }
+
     public:
-        harris_kcas();
-        harris_kcas(harris_kcas &&) = default;
-        harris_kcas(const harris_kcas &) = default;
-        harris_kcas &operator=(harris_kcas &&) = default;
-        harris_kcas &operator=(const harris_kcas &) = default;
-        ~harris_kcas();
+        explicit
+        harris_kcas(const unsigned& threads, MemReclaimer& reclaimer) :
+            _reclaimer(reclaimer)
+#ifdef CRH_KCAS_STATS
+            , _statistics(threads)
+#endif
+        {
+            static_cast<void>(threads);
+        }
+
+        harris_kcas(const harris_kcas&) = delete;
+        harris_kcas &operator=(const harris_kcas&) = delete;
+
+        ~harris_kcas() {}
+
+        /**
+         * @brief Reads the logical value of a word. Words
+         * holding a descriptor resolve to the value the
+         * descriptor will leave behind, without helping.
+         * The caller must be pinned in the memory reclaimer.
+         * A descriptor found by a relaxed load is only
+         * followed after loading the word again with acquire
+         *
+         * @param addr The word to be read
+         * @param order The memory order of the load
+         * @return state_type The logical value of the word
+         */
+        state_type read(const std::atomic<state_type>& addr,
+            const std::memory_order order = Ordering::S_LOAD) const noexcept
+        {
+            state_type value = addr.load(order);
+            if (order == std::memory_order_relaxed && (is_rdcss(value) || is_kcas(value)))
+                value = addr.load(std::memory_order_acquire);
+
+            if (is_rdcss(value)) return to_rdcss(value)->_expected_d_value;
+
+            if (!is_kcas(value)) return value;
+
+            const k_cas_descriptor* desc = to_k_cas(value);
+            for (alloc_type i = 0; i < desc->_size; ++i)
+            {
+                if (desc->_entries[i]._addr == &addr)
+                    return desc->_status.load(Ordering::S_LOAD) == SUCCESS ? desc->_entries[i]._new_val : desc->_entries[i]._old_val;
+            }
+            return value;
+        }
+
+        /**
+         * @brief Multi-word compare and swap method
+         *
+         * @param thread_id The calling thread
+         * @param first The first word to be swapped
+         * @param last One past the last word to be swapped
+         * @return true if every word held its old value
+         * and now holds its new one
+         * @return false if any word differed, in which
+         * case no word was modified
+         */
+        bool cas(const unsigned& thread_id, entry_type* first, entry_type* last)
+        {
+            const alloc_type size = last - first;
+            assert(size <= S_MAX_ENTRIES);
+
+            sort_kcas_entries(first, last);
+
+            reclamation::reclaimer_pin<MemReclaimer, Ordering> pin(this->_reclaimer, thread_id);
+
+            k_cas_descriptor* desc = std::allocator_traits<k_cas_allocator>::allocate(this->_k_cas_allocator, 1);
+            std::allocator_traits<k_cas_allocator>::construct(this->_k_cas_allocator, desc);
+
+            desc->_size = size;
+            desc->_entries = std::allocator_traits<entry_allocator>::allocate(this->_entry_allocator, size);
+            std::copy(first, last, desc->_entries);
+
+            const bool succeeded = this->help(thread_id, desc);
+
+            pin.retire(record_handle{desc, this, &delete_k_cas});
+            return succeeded;
+        }
+
+#ifdef CRH_KCAS_STATS
+        /**
+         * @brief Operations of other threads helped to
+         * completion by a thread
+         *
+         */
+        std::size_t helps(const unsigned& thread_id) const noexcept { return this->_statistics.helps(thread_id); }
+#endif
     };
 } // namespace crh
 
@@ -6,6 +6,68 @@
 #include <cassert>
 #include <cstdint>
 #include <memory>
+#include <stdexcept>
 #include <type_traits>
 
+namespace crh
+{
+    /**
+     * @brief A single word taking part in a
+     * multi-word compare and swap
+     * 
+     * @tparam WordType A word of specified bit size
+     */
+    template< class WordType >
+    struct kcas_entry
+    {
+        std::atomic<WordType>* _addr;
+        
+        WordType _old_val, _new_val;
+    };
+
+    /**
+     * @brief Orders the words of a kCAS by address, which
+     * both implementations require for lock freedom
+     * 
+     * @tparam WordType A word of specified bit size
+     */
+    template< class WordType >
+    inline
+    void sort_kcas_entries(kcas_entry<WordType>* first, kcas_entry<WordType>* last) noexcept
+    {
+        std::sort(first, last, [](const kcas_entry<WordType>& a, const kcas_entry<WordType>& b)
+        {
+            return a._addr < b._addr;
+        });
+    }
+
+#ifdef CRH_KCAS_STATS
+    /**
+     * @brief Per-thread count of operations of other
+     * threads that a thread helped to complete. Only
+     * compiled in when CRH_KCAS_STATS is defined
+     * 
+     */
+    class kcas_statistics
+    {
+    private:
+        struct alignas(128) counter
+        {
+            std::size_t _helps = 0;
+        };
+
+        std::unique_ptr<counter[]> _counters;
+
+    public:
+        explicit
+        kcas_statistics(const unsigned& threads) :
+            _counters(std::make_unique<counter[]>(threads)) {}
+
+        void helped(const unsigned& thread_id) noexcept { ++this->_counters[thread_id]._helps; }
+
+        std::size_t helps(const unsigned& thread_id) const noexcept { return this->_counters[thread_id]._helps; }
+    };
+#endif
+} // namespace crh
+
 #endif // !CRH_KCAS_PRECOMP_HPP
\ No newline at end of file
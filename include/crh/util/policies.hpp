@@ -2,6 +2,11 @@
 #define CRH_POLICIES_HPP
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
 #if __x86_64
 #include <emmintrin.h>
 #else
@@ -46,6 +51,52 @@ namespace backoff
         }
     };
 } // namespace backoff
+namespace ordering
+{
+    /**
+     * @brief Every atomic access of the table and the kCAS is
+     * sequentially consistent. Kept as the reference the weaker
+     * ordering is checked against
+     *
+     */
+    struct sequentially_consistent
+    {
+        static constexpr std::memory_order S_LOAD = std::memory_order_seq_cst;
+        static constexpr std::memory_order S_VALIDATE = std::memory_order_seq_cst;
+        static constexpr std::memory_order S_STORE = std::memory_order_seq_cst;
+        static constexpr std::memory_order S_UPDATE = std::memory_order_seq_cst;
+        static constexpr std::memory_order S_UPDATE_FAILURE = std::memory_order_seq_cst;
+        static constexpr std::memory_order S_COUNTER = std::memory_order_seq_cst;
+    };
+
+    /**
+     * @brief Loads acquire and stores release, so a value read
+     * carries everything its writer published before it. Every
+     * word is only ever changed by compare and swap, which orders
+     * the operations on one word. The one store-buffering pattern,
+     * a reader announcing its epoch before loading a word while a
+     * retiring thread unlinks the word before scanning the
+     * announcements, is ordered by the sequentially consistent
+     * fences the epoch reclaimer adds under this policy rather
+     * than by these orders.
+     *
+     * The timestamps re-read to validate a lookup are loaded
+     * relaxed: the bucket loads before them are acquire, and any
+     * bucket value a lookup saw from a kCAS makes the timestamp
+     * that kCAS advanced visible as well. Counters that publish
+     * nothing are relaxed too
+     *
+     */
+    struct acquire_release
+    {
+        static constexpr std::memory_order S_LOAD = std::memory_order_acquire;
+        static constexpr std::memory_order S_VALIDATE = std::memory_order_relaxed;
+        static constexpr std::memory_order S_STORE = std::memory_order_release;
+        static constexpr std::memory_order S_UPDATE = std::memory_order_acq_rel;
+        static constexpr std::memory_order S_UPDATE_FAILURE = std::memory_order_acquire;
+        static constexpr std::memory_order S_COUNTER = std::memory_order_relaxed;
+    };
+} // namespace ordering
 namespace reclamation
 {
     /**
@@ -67,7 +118,7 @@ namespace reclamation
 
         void free(std::shared_ptr<void> ptr)
         {
-            return Allocator::malloc_usable_size(ptr);
+            return Allocator::free(ptr);
         }
 
         unsigned malloc_usable_size(std::shared_ptr<void> ptr)
@@ -76,48 +127,300 @@ namespace reclamation
         }
     };
     
-    template< class MemReclaimer >
+    /**
+     * @brief Epoch based memory reclaimer. Records retired while
+     * any thread is pinned in an older epoch are held back until
+     * every active thread has observed two further epochs.
+     * 
+     */
+    class epoch_reclaimer
+    {
+    public:
+        /**
+         * @brief A retired record together with the
+         * function that releases it
+         * 
+         */
+        struct record_handle
+        {
+            void* _ptr;
+            void* _context;
+            void (*_deleter)(void* context, void* ptr);
+        };
+    
+    private:
+        static constexpr std::uint64_t S_INACTIVE = std::numeric_limits<std::uint64_t>::max();
+        static constexpr unsigned S_EPOCHS = 3, S_ADVANCE_INTERVAL = 64;
+
+        struct alignas(128) thread_record
+        {
+            std::atomic<std::uint64_t> _announced{S_INACTIVE};
+            
+            unsigned _depth = 0, _retired_since_advance = 0;
+            
+            std::uint64_t _limbo_epoch[S_EPOCHS] = {};
+            std::vector<record_handle> _limbo[S_EPOCHS];
+        };
+
+        std::atomic<std::uint64_t> _epoch;
+        
+        unsigned _threads;
+        
+        std::unique_ptr<thread_record[]> _records;
+
+        static
+        void release(std::vector<record_handle>& limbo) noexcept
+        {
+            for (const record_handle& handle : limbo) handle._deleter(handle._context, handle._ptr);
+            limbo.clear();
+        }
+
+        // Only unlinks and loads weaker than seq_cst need fences around the announcements
+        template< class Ordering >
+        static
+        constexpr
+        bool fenced() noexcept
+        {
+            return Ordering::S_UPDATE != std::memory_order_seq_cst || Ordering::S_LOAD != std::memory_order_seq_cst;
+        }
+
+        bool try_advance(const std::uint64_t& epoch) noexcept
+        {
+            for (unsigned i = 0; i < this->_threads; ++i)
+            {
+                std::uint64_t announced = this->_records[i]._announced.load();
+                if (announced != S_INACTIVE && announced != epoch) return false;
+            }
+
+            std::uint64_t expected = epoch;
+            return this->_epoch.compare_exchange_strong(expected, epoch + 1);
+        }
+
+    public:
+        explicit
+        epoch_reclaimer(const unsigned& threads) :
+            _epoch(S_EPOCHS),
+            _threads(threads),
+            _records(std::make_unique<thread_record[]>(threads)) {}
+
+        epoch_reclaimer(const epoch_reclaimer&) = delete;
+        epoch_reclaimer &operator=(const epoch_reclaimer&) = delete;
+
+        ~epoch_reclaimer()
+        {
+            for (unsigned i = 0; i < this->_threads; ++i)
+                for (unsigned e = 0; e < S_EPOCHS; ++e) release(this->_records[i]._limbo[e]);
+        }
+
+        /**
+         * @brief Announces the current epoch. Under an ordering
+         * whose loads are only acquire, a fence between the
+         * announcement and the re-read of the epoch keeps the
+         * announcement from passing the protected loads after it
+         *
+         * @tparam Ordering A memory ordering policy
+         */
+        template< class Ordering = ordering::sequentially_consistent >
+        void enter(const unsigned& thread_id) noexcept
+        {
+            thread_record& record = this->_records[thread_id];
+            if (record._depth++ != 0) return;
+
+            for (std::uint64_t epoch = this->_epoch.load(Ordering::S_LOAD), current; ; epoch = current)
+            {
+                if constexpr (fenced<Ordering>())
+                {
+                    record._announced.store(epoch, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                }
+                else record._announced.store(epoch);
+
+                if ((current = this->_epoch.load(Ordering::S_LOAD)) == epoch) break;
+            }
+        }
+
+        void exit(const unsigned& thread_id) noexcept
+        {
+            thread_record& record = this->_records[thread_id];
+            if (--record._depth == 0) record._announced.store(S_INACTIVE);
+        }
+
+        template< class Ordering = ordering::sequentially_consistent >
+        void retire(const unsigned& thread_id, const record_handle& handle)
+        {
+            this->retire<Ordering>(thread_id, &handle, &handle + 1);
+        }
+
+        /**
+         * @brief Retires a batch of records under a
+         * single read of the global epoch
+         * 
+         * @tparam Ordering The memory ordering policy
+         * the records were unlinked under
+         */
+        template< class Ordering = ordering::sequentially_consistent >
+        void retire(const unsigned& thread_id, const record_handle* first, const record_handle* last)
+        {
+            thread_record& record = this->_records[thread_id];
+
+            // Orders acq_rel unlinks before the epoch and announcements are read
+            if constexpr (fenced<Ordering>()) std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            const std::uint64_t epoch = this->_epoch.load();
+            const unsigned slot = epoch % S_EPOCHS;
+
+            if (record._limbo_epoch[slot] != epoch)
+            {
+                // The slot was last filled at least S_EPOCHS epochs ago
+                release(record._limbo[slot]);
+                record._limbo_epoch[slot] = epoch;
+            }
+            record._limbo[slot].insert(record._limbo[slot].end(), first, last);
+
+            record._retired_since_advance += unsigned(last - first);
+            if (record._retired_since_advance >= S_ADVANCE_INTERVAL)
+            {
+                record._retired_since_advance = 0;
+                this->try_advance(epoch);
+            }
+        }
+    };
+    
+    template< class MemReclaimer, class Ordering = ordering::sequentially_consistent >
     class reclaimer_pin
     {
     public:
         using record_handle = typename MemReclaimer::record_handle;
-        using record_base = typename MemReclaimer::record_base;
     
     private:
-        unsigned _thread_id;
+        MemReclaimer& _reclaimer;
         
-        MemReclaimer _reclaimer;
+        unsigned _thread_id;
 
     public:
-        reclaimer_pin(const MemReclaimer& reclaimer, const unsigned& thread_id) :
+        reclaimer_pin(MemReclaimer& reclaimer, const unsigned& thread_id) :
             _reclaimer(reclaimer),
             _thread_id(thread_id)
         {
-            this->_reclaimer->enter(this->_thread_id);
+            this->_reclaimer.template enter<Ordering>(this->_thread_id);
         }
 
-        ~reclaimer_pin() { this->_reclaimer->exit(this->_thread_id); }
+        reclaimer_pin(const reclaimer_pin&) = delete;
+        reclaimer_pin &operator=(const reclaimer_pin&) = delete;
+
+        ~reclaimer_pin() { this->_reclaimer.exit(this->_thread_id); }
 
-        record_handle get_rec() { return this->_reclaimer->get_rec(this->_thread_id); }
+        void retire(const record_handle& handle) { this->_reclaimer.template retire<Ordering>(this->_thread_id, handle); }
 
-        void retire(const record_handle& handle) { this->_reclaimer->exit(this->_thread_id); }
+        void retire(const record_handle* first, const record_handle* last)
+        {
+            this->_reclaimer.template retire<Ordering>(this->_thread_id, first, last);
+        }
     };
     
+    /**
+     * @brief Fix the number of buckets at compile time. The
+     * bucket array is stored inline and never resized, so value
+     * must be a power of two large enough for every entry. The
+     * table never holds more than five eighths of value entries,
+     * however many threads insert at once: an insert past that
+     * throws std::length_error, as does the rare insert whose
+     * chain grows too long for one multi-word update; erasing
+     * never fails
+     * 
+     * @tparam value 
+     */
     template< std::size_t value >
-    struct buckets;
+    struct buckets {};
 
     template< typename T >
     struct map_to_bucket;
 
+    /**
+     * @brief Shrink the table by cooperative migration once
+     * fewer than value percent of its buckets hold an entry,
+     * though never below the size it was constructed with.
+     * Zero, the default, keeps the table at its peak size
+     * 
+     * @tparam value 
+     */
+    template< std::size_t value >
+    struct min_load {};
+
+    /**
+     * @brief Cap the distance of every entry from its home
+     * bucket, and the buckets a single insert or erase step
+     * updates at once. Entries that would be pushed further go
+     * into a small overflow stash, and a filling stash grows the
+     * table early. Keys sharing one hash can fill only the stash
+     * and the value + 1 buckets from their home, whatever the size
+     * of the table, so an insert of one more throws
+     * std::length_error. Keys whose hashes only share their low
+     * bits grow the table a few doublings past what its load calls
+     * for, then throw the same. Zero leaves the distance unbounded
+     * 
+     * @tparam value 
+     */
+    template< std::size_t value >
+    struct max_displacement {};
+
+    /**
+     * @brief Store the full hash of every entry next to it, so that
+     * migration and backward shifts never call the hasher again and
+     * lookups reject mismatching entries before comparing keys
+     * 
+     * @tparam value 
+     */
     template< bool value >
-    struct memoize_hash;
+    struct memoize_hash {};
+
+    /**
+     * @brief Seed the hasher with value, for hashers that take
+     * a seed on construction, as the default string hashers do.
+     * Zero leaves each hasher its default, a seed drawn at random
+     * once per process
+     * 
+     * @tparam value 
+     */
+    template< std::uint64_t value >
+    struct hash_seed {};
+
+    template< typename T >
+    struct reclaimer { using reclaimer_type = T; };
+
+    template< typename T >
+    struct kcas { using kcas_type = T; };
 
     template< typename Backoff >
     struct backoff { using backoff_type = Backoff; };
 
+    /**
+     * @brief Memory orders of the atomic accesses in the table
+     * and the default kCAS, one of the structs in crh::ordering.
+     * The table pins and retires with the same policy, so a
+     * reclaimer can order its announcement before the loads it
+     * protects, and an unlink before its scan of announcements,
+     * with fences only when they are weaker than seq_cst, as the
+     * epoch reclaimer does
+     * 
+     * @tparam Ordering 
+     */
+    template< typename Ordering >
+    struct ordering { using ordering_type = Ordering; };
+
     template< typename T >
     struct hash { using hash_type = T; };
 
+    /**
+     * @brief Record every keyed operation of the map, with one of
+     * the recorders in crh::trace. The map constructs the recorder
+     * with its thread count and hands it out by trace_recorder()
+     * 
+     * @tparam Recorder 
+     */
+    template< typename Recorder >
+    struct trace { using recorder_type = Recorder; };
+
     template< typename T >
     struct allocation_strategy { using strategy_type = T; };
 } // namespace reclamation
@@ -0,0 +1,307 @@
+#ifndef CRH_TRACE_HPP
+#define CRH_TRACE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace crh
+{
+namespace trace
+{
+    enum class op : std::uint8_t
+    {
+        FIND,
+        INSERT,
+        ERASE
+    };
+
+    // The key field holds the key itself rather than its hash
+    static constexpr std::uint8_t S_KEY_BYTES = 0x1;
+
+    // The operation found, inserted or erased its key
+    static constexpr std::uint8_t S_SUCCEEDED = 0x2;
+
+    /**
+     * @brief One operation of a trace. The timestamp counts
+     * nanoseconds from the opening of the trace to the start
+     * of the operation, the time a replay issues it again
+     *
+     */
+    struct event
+    {
+        std::uint64_t _timestamp;
+        std::uint64_t _key;
+        std::uint32_t _thread_id;
+        op _op;
+        std::uint8_t _flags;
+        std::uint16_t _reserved;
+    };
+
+    static_assert(sizeof(event) == 24, "trace events must stay packed.");
+
+    /**
+     * @brief Start of a trace file, followed by its events
+     * in native byte order. Events of one thread appear in
+     * order, those of different threads interleave in batches
+     *
+     */
+    struct header
+    {
+        char _magic[8];
+        std::uint32_t _version;
+        std::uint32_t _event_size;
+    };
+
+    static constexpr char S_MAGIC[8] = {'C', 'R', 'H', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr std::uint32_t S_VERSION = 1;
+
+    /**
+     * @brief Keys of at most eight bytes that are trivially
+     * copyable are recorded as they are, any other key by its
+     * hash
+     *
+     */
+    template< class Key, class KeyHash >
+    std::uint64_t encode_key(const Key& key, const KeyHash& key_hash, std::uint8_t& flags)
+    {
+        if constexpr (std::is_trivially_copyable<Key>::value && sizeof(Key) <= sizeof(std::uint64_t))
+        {
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &key, sizeof(Key));
+            flags |= S_KEY_BYTES;
+            return bits;
+        }
+        else return static_cast<std::uint64_t>(key_hash(key));
+    }
+
+    /**
+     * @brief The default, recording nothing
+     *
+     */
+    struct no_trace
+    {
+        static constexpr bool S_ENABLED = false;
+
+        explicit
+        no_trace(const unsigned&) noexcept {}
+    };
+
+    /**
+     * @brief Records every operation of a map into a single
+     * producer ring per thread, which a writer thread drains to
+     * the trace file. A thread whose ring is full waits for the
+     * writer rather than dropping events, so a trace is complete
+     * unless writing it fails. Nothing is recorded until a trace
+     * is opened, and opening and closing must not race with
+     * operations
+     *
+     * @tparam RingSize Events per thread, a power of two
+     */
+    template< std::size_t RingSize = 4096 >
+    class ring_recorder
+    {
+    public:
+        static constexpr bool S_ENABLED = true;
+
+        static_assert(RingSize != 0 && (RingSize & (RingSize - 1)) == 0, "ring size must be a power of two.");
+
+    private:
+        static constexpr auto S_WRITER_INTERVAL = std::chrono::microseconds(500);
+
+        struct alignas(128) ring
+        {
+            std::atomic<std::size_t> _head{0};
+            alignas(128) std::atomic<std::size_t> _tail{0};
+            std::unique_ptr<event[]> _events{new event[RingSize]};
+        };
+
+        unsigned _threads;
+
+        std::unique_ptr<ring[]> _rings;
+
+        std::FILE* _file = nullptr;
+
+        std::chrono::steady_clock::time_point _start;
+
+        std::atomic<bool> _recording{false}, _writing{false};
+
+        // Set by the writer once a write fails; later events are discarded
+        bool _failed = false;
+
+        std::thread _writer;
+
+        /**
+         * @brief Writes out every event published so far, or
+         * discards them once a write has failed, so producers
+         * never wait on a broken file
+         *
+         * @return Whether there was anything to write
+         */
+        bool drain()
+        {
+            bool written = false;
+
+            for (unsigned i = 0; i < this->_threads; ++i)
+            {
+                ring& r = this->_rings[i];
+
+                const std::size_t head = r._head.load(std::memory_order_acquire);
+                const std::size_t tail = r._tail.load(std::memory_order_relaxed);
+                if (head == tail) continue;
+
+                // The published events wrap around the end of the ring at most once
+                const std::size_t first = tail & (RingSize - 1), count = head - tail;
+                const std::size_t contiguous = std::min(count, RingSize - first);
+
+                if (!this->_failed)
+                {
+                    this->_failed = std::fwrite(r._events.get() + first, sizeof(event), contiguous, this->_file) != contiguous
+                        || std::fwrite(r._events.get(), sizeof(event), count - contiguous, this->_file) != count - contiguous;
+                }
+
+                r._tail.store(head, std::memory_order_release);
+                written = true;
+            }
+            return written;
+        }
+
+        void write_loop()
+        {
+            while (this->_writing.load(std::memory_order_acquire))
+                if (!this->drain()) std::this_thread::sleep_for(S_WRITER_INTERVAL);
+
+            this->drain();
+        }
+
+    public:
+        explicit
+        ring_recorder(const unsigned& threads) :
+            _threads(threads),
+            _rings(std::make_unique<ring[]>(threads)) {}
+
+        ring_recorder(const ring_recorder&) = delete;
+        ring_recorder &operator=(const ring_recorder&) = delete;
+
+        ~ring_recorder() { this->close(); }
+
+        /**
+         * @brief Starts recording into a new trace file,
+         * closing any trace still open
+         *
+         * @return false if the file cannot be written
+         */
+        bool open(const char* path)
+        {
+            this->close();
+
+            this->_file = std::fopen(path, "wb");
+            if (!this->_file) return false;
+
+            header h{{}, S_VERSION, sizeof(event)};
+            std::memcpy(h._magic, S_MAGIC, sizeof(S_MAGIC));
+
+            if (std::fwrite(&h, sizeof(h), 1, this->_file) != 1)
+            {
+                std::fclose(this->_file);
+                this->_file = nullptr;
+                return false;
+            }
+
+            this->_failed = false;
+            this->_start = std::chrono::steady_clock::now();
+            this->_writing.store(true, std::memory_order_release);
+            this->_writer = std::thread(&ring_recorder::write_loop, this);
+            this->_recording.store(true, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Stops recording and writes out the
+         * remaining events
+         *
+         * @return false if writing the trace failed, so the
+         * file is incomplete
+         */
+        bool close()
+        {
+            if (!this->_file) return true;
+
+            this->_recording.store(false, std::memory_order_release);
+            this->_writing.store(false, std::memory_order_release);
+            this->_writer.join();
+
+            const bool closed = std::fclose(this->_file) == 0;
+            this->_file = nullptr;
+
+            return closed && !this->_failed;
+        }
+
+        bool recording() const noexcept { return this->_recording.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief Nanoseconds since the trace was opened, taken
+         * when an operation starts
+         *
+         */
+        std::uint64_t timestamp() const noexcept
+        {
+            return static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->_start).count());
+        }
+
+        void record(const unsigned& thread_id, const std::uint64_t& timestamp,
+            const op& operation, const std::uint64_t& key, const std::uint8_t& flags) noexcept
+        {
+            if (!this->_recording.load(std::memory_order_acquire)) return;
+
+            ring& r = this->_rings[thread_id];
+            const std::size_t head = r._head.load(std::memory_order_relaxed);
+
+            // A full ring waits for the writer, unless the trace is being closed
+            while (head - r._tail.load(std::memory_order_acquire) == RingSize)
+            {
+                if (!this->_recording.load(std::memory_order_acquire)) return;
+                std::this_thread::yield();
+            }
+
+            r._events[head & (RingSize - 1)] = event{timestamp, key, thread_id, operation, flags, 0};
+            r._head.store(head + 1, std::memory_order_release);
+        }
+    };
+
+    /**
+     * @brief Reads the events of a trace file
+     *
+     * @return false if the file is missing or not a trace
+     */
+    inline
+    bool load(const char* path, std::vector<event>& events)
+    {
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen(path, "rb"), &std::fclose);
+        if (!file) return false;
+
+        header h;
+        if (std::fread(&h, sizeof(h), 1, file.get()) != 1 || std::memcmp(h._magic, S_MAGIC, sizeof(S_MAGIC)) != 0
+            || h._version != S_VERSION || h._event_size != sizeof(event))
+            return false;
+
+        events.clear();
+
+        event buffer[1024];
+        for (std::size_t count; (count = std::fread(buffer, sizeof(event), 1024, file.get())) != 0;)
+            events.insert(events.end(), buffer, buffer + count);
+
+        return true;
+    }
+} // namespace trace
+} // namespace crh
+
+#endif // !CRH_TRACE_HPP
\ No newline at end of file
@@ -2,38 +2,81 @@
 #define CRH_UTILS_HPP
 
 #include <atomic>
+#include <cassert>
 #include <memory>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <pthread.h>
+#include <chrono>
 #include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace crh
 {
 namespace ops
 {
+    /**
+     * @brief One based position of the highest set
+     * bit, or zero if no bit is set
+     * 
+     */
     template< typename T >
     inline
     constexpr
     unsigned find_last_bit_set(const T& val) noexcept
     {
         unsigned result = 0;
-        for(; val != 0; val >>= 0) ++result;
+        for (T bits = val; bits != 0; bits >>= 1) ++result;
         return result;
     }
 
+    /**
+     * @brief One based position of the lowest set
+     * bit, or zero if no bit is set
+     * 
+     */
+    inline
+    unsigned find_first_bit_set(const unsigned& val) noexcept
+    {
+        #if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_ffs(static_cast<int>(val)));
+        #else
+            if (val == 0) return 0;
+
+            unsigned result = 1;
+            for (unsigned bits = val; (bits & 1) == 0; bits >>= 1) ++result;
+            return result;
+        #endif
+    }
+
+    /**
+     * @brief Hints that the cache line holding
+     * an address will be read soon
+     * 
+     */
+    inline
+    void prefetch(const void* addr) noexcept
+    {
+        #if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(addr);
+        #else
+            (void)addr;
+        #endif
+    }
+
     template< typename T >
     struct modulo
     {
-        T operator()(const T& a, const T& b) { return a % b; }
+        constexpr
+        T operator()(const T& a, const T& b) const noexcept { return a % b; }
     };
 } // namespace ops
 namespace lock_guard
 {
-    #if __x86_64
-    #include <immintrin.h>
-    #endif
-
     class alignas(128) p_thread_spin_lock
     {
     private:
@@ -59,32 +102,260 @@ namespace hash
     using hash_type = std::size_t;
     using trunc_hash_type = std::uint_least32_t;
 
+    namespace detail
+    {
+        inline
+        std::uint64_t read_64(const unsigned char* p) noexcept
+        {
+            std::uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline
+        std::uint64_t read_32(const unsigned char* p) noexcept
+        {
+            std::uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        /**
+         * @brief Full 64 by 64 bit multiply, leaving the
+         * low half in a and the high half in b
+         * 
+         */
+        inline
+        void multiply_128(std::uint64_t& a, std::uint64_t& b) noexcept
+        {
+        #if defined(__SIZEOF_INT128__)
+            const unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+            a = static_cast<std::uint64_t>(r);
+            b = static_cast<std::uint64_t>(r >> 64);
+        #else
+            const std::uint64_t a_hi = a >> 32, a_lo = static_cast<std::uint32_t>(a);
+            const std::uint64_t b_hi = b >> 32, b_lo = static_cast<std::uint32_t>(b);
+            const std::uint64_t hh = a_hi * b_hi, hl = a_hi * b_lo, lh = a_lo * b_hi, ll = a_lo * b_lo;
+            const std::uint64_t mid = (ll >> 32) + static_cast<std::uint32_t>(hl) + static_cast<std::uint32_t>(lh);
+            a = (mid << 32) | static_cast<std::uint32_t>(ll);
+            b = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+        #endif
+        }
+
+        inline
+        std::uint64_t multiply_mix(std::uint64_t a, std::uint64_t b) noexcept
+        {
+            multiply_128(a, b);
+            return a ^ b;
+        }
+
+        inline constexpr std::uint64_t S_SECRET[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                                      0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+        /**
+         * @brief Seed of the byte hashers not given one, drawn
+         * once per process, so keys chosen to collide under one
+         * run's hashes do not collide under the next run's. The
+         * clock stands in where no random device is available
+         *
+         */
+        inline
+        std::uint64_t random_seed() noexcept
+        {
+            static const std::uint64_t seed = []() noexcept
+            {
+                try
+                {
+                    std::random_device device;
+                    return (std::uint64_t(device()) << 32) ^ device();
+                }
+                catch (...)
+                {
+                    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+                }
+            }();
+            return seed;
+        }
+    } // namespace detail
+
+    /**
+     * @brief Multiply-xorshift finalizer. Every input bit
+     * reaches every output bit, so the low bits used to pick
+     * a bucket depend on the whole word
+     * 
+     */
+    inline
+    constexpr
+    std::uint64_t mix(std::uint64_t x) noexcept
+    {
+        x ^= x >> 27;
+        x *= 0x3c79ac492ba7b653ull;
+        x ^= x >> 33;
+        x *= 0x1c69b3f74ac4ae35ull;
+        x ^= x >> 27;
+        return x;
+    }
+
+    /**
+     * @brief Hashes a byte span with wyhash. Long inputs
+     * run three independent multiply lanes over 48 byte
+     * blocks, which keeps the multipliers busy without
+     * needing vector instructions
+     * 
+     */
+    inline
+    hash_type hash_bytes(const void* data, const std::size_t& len, std::uint64_t seed = 0) noexcept
+    {
+        using detail::S_SECRET;
+
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        std::uint64_t a, b;
+
+        seed ^= detail::multiply_mix(seed ^ S_SECRET[0], S_SECRET[1]);
+
+        if (len <= 16)
+        {
+            if (len >= 4)
+            {
+                a = (detail::read_32(p) << 32) | detail::read_32(p + ((len >> 3) << 2));
+                b = (detail::read_32(p + len - 4) << 32) | detail::read_32(p + len - 4 - ((len >> 3) << 2));
+            }
+            else if (len > 0)
+            {
+                a = (std::uint64_t(p[0]) << 16) | (std::uint64_t(p[len >> 1]) << 8) | p[len - 1];
+                b = 0;
+            }
+            else a = b = 0;
+        }
+        else
+        {
+            std::size_t i = len;
+            if (i > 48)
+            {
+                std::uint64_t see1 = seed, see2 = seed;
+                do
+                {
+                    seed = detail::multiply_mix(detail::read_64(p) ^ S_SECRET[1], detail::read_64(p + 8) ^ seed);
+                    see1 = detail::multiply_mix(detail::read_64(p + 16) ^ S_SECRET[2], detail::read_64(p + 24) ^ see1);
+                    see2 = detail::multiply_mix(detail::read_64(p + 32) ^ S_SECRET[3], detail::read_64(p + 40) ^ see2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                seed ^= see1 ^ see2;
+            }
+
+            while (i > 16)
+            {
+                seed = detail::multiply_mix(detail::read_64(p) ^ S_SECRET[1], detail::read_64(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+
+            a = detail::read_64(p + i - 16);
+            b = detail::read_64(p + i - 8);
+        }
+
+        a ^= S_SECRET[1];
+        b ^= seed;
+        detail::multiply_128(a, b);
+
+        return static_cast<hash_type>(detail::multiply_mix(a ^ S_SECRET[0] ^ len, b ^ S_SECRET[1]));
+    }
+
+    /**
+     * @brief Default hasher. Integers and enums are mixed
+     * with mix(), strings and string views are hashed as
+     * bytes under a seed, and any other key falls back to
+     * std::hash with its result mixed, since std::hash is the
+     * identity for many standard types
+     * 
+     * @tparam key 
+     */
     template< typename key >
     class hash
     {
-    private:
-        std::hash<key> _hash;
-    
     public:
-        hash_type operator() (const key& k) const noexcept { return _hash(k); }
+        hash_type operator() (const key& k) const noexcept
+        {
+            if constexpr (std::is_integral<key>::value || std::is_enum<key>::value)
+                return static_cast<hash_type>(mix(static_cast<std::uint64_t>(k)));
+            else
+                return static_cast<hash_type>(mix(std::hash<key>()(k)));
+        }
     };
+
+    /**
+     * @brief Pointers drop the low bits their alignment
+     * keeps clear before mixing
+     * 
+     * @tparam key 
+     */
     template< typename key >
     class hash<key*>
     {
+    private:
+        static constexpr std::size_t alignment()
+        {
+            if constexpr (std::is_object<key>::value) return alignof(key);
+            else return 1;
+        }
+
     public:
-        hash_type operator()(const key&& k) const noexcept
+        hash_type operator()(key* const& k) const noexcept
         {
             constexpr 
-            auto alignment = std::alignment_of<key>();
+            auto shift = ops::find_last_bit_set(alignment()) - 1;
             
-            constexpr 
-            auto shift = ops::find_last_bit_set(alignment) - 1;
+            auto address = reinterpret_cast<std::uintptr_t>(k);
             
-            auto hash = reinterpret_cast<hash_type>(k);
+            assert((address >> shift) << shift == address);
             
-            assert((hash >> shift) << shift == hash);
-            
-            return hash >> shift;
+            return static_cast<hash_type>(mix(address >> shift));
+        }
+    };
+
+    /**
+     * @brief Strings and string views are hashed under the
+     * seed given to the constructor, or the process's random
+     * seed by default, so that the keys which collide differ
+     * from run to run
+     *
+     * @tparam CharT
+     * @tparam Traits
+     */
+    template< typename CharT, typename Traits >
+    class hash<std::basic_string_view<CharT, Traits>>
+    {
+    private:
+        std::uint64_t _seed;
+
+    public:
+        hash() noexcept : _seed(detail::random_seed()) {}
+
+        explicit
+        hash(const std::uint64_t& seed) noexcept : _seed(seed) {}
+
+        hash_type operator()(const std::basic_string_view<CharT, Traits>& k) const noexcept
+        {
+            return hash_bytes(k.data(), k.size() * sizeof(CharT), this->_seed);
+        }
+    };
+
+    template< typename CharT, typename Traits, typename Alloc >
+    class hash<std::basic_string<CharT, Traits, Alloc>>
+    {
+    private:
+        std::uint64_t _seed;
+
+    public:
+        hash() noexcept : _seed(detail::random_seed()) {}
+
+        explicit
+        hash(const std::uint64_t& seed) noexcept : _seed(seed) {}
+
+        hash_type operator()(const std::basic_string<CharT, Traits, Alloc>& k) const noexcept
+        {
+            return hash_bytes(k.data(), k.size() * sizeof(CharT), this->_seed);
         }
     };
 
@@ -99,10 +370,10 @@ namespace hash
     {
     protected:
         inline
-        void set_hash(const hash_type& hash) const noexcept {}
+        void set_hash(const hash_type&) noexcept {}
 
     public:
-        bool bucket_hash_equal(const hash_type& hash) const noexcept { return true; }
+        bool bucket_hash_equal(const hash_type&) const noexcept { return true; }
         trunc_hash_type truncated_hash() const noexcept { return 0; }
     };
     /**
@@ -115,23 +386,29 @@ namespace hash
     class bucket_entry_hash<true>
     {
     private:
-        static trunc_hash_type _hash;
+        hash_type _hash = 0;
 
     protected:
         inline
-        void set_hash(const trunc_hash_type& hash) const noexcept
+        void set_hash(const hash_type& hash) noexcept
         {
-            this->_hash = trunc_hash_type(hash);
+            this->_hash = hash;
         }
     
     public:
         bool bucket_hash_equal(const hash_type& hash) const noexcept
         {
-            return this->_hash == trunc_hash_type(hash);
+            return this->_hash == hash;
         }
 
         inline
         trunc_hash_type truncated_hash() const noexcept
+        {
+            return trunc_hash_type(this->_hash);
+        }
+
+        inline
+        hash_type stored_hash() const noexcept
         {
             return this->_hash;
         }
@@ -0,0 +1,154 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief Lookups awaited through async_find and an
+ * interleaving_scheduler, which must report what find reports:
+ * hits and misses, stashed entries, and keys whose table is
+ * replaced between the steps of a lookup or by writers on other
+ * threads.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    template< class Map >
+    crh::async::detached lookup(Map& map, crh::async::interleaving_scheduler& scheduler, const key_type key,
+        const unsigned thread_id, std::optional<key_type>& result)
+    {
+        // Awaited outside the condition, which some compilers get wrong
+        const std::optional<key_type> value = co_await map.async_find(key, thread_id, scheduler);
+        result = value;
+    }
+
+    /**
+     * @brief Starts an async_find of every key on one scheduler
+     * and runs them all, interleaved
+     *
+     */
+    template< class Map >
+    std::vector<std::optional<key_type>> lookup_all(Map& map, const std::vector<key_type>& keys, const unsigned thread_id)
+    {
+        crh::async::interleaving_scheduler scheduler;
+        std::vector<std::optional<key_type>> results(keys.size());
+
+        for (std::size_t i = 0; i < keys.size(); ++i) lookup(map, scheduler, keys[i], thread_id, results[i]);
+        scheduler.run();
+
+        return results;
+    }
+
+    // Every result agrees with find on the same key
+    template< class Map >
+    bool agrees_with_find(Map& map, const std::vector<key_type>& keys, const std::vector<std::optional<key_type>>& results)
+    {
+        bool agrees = true;
+        for (std::size_t i = 0; i < keys.size(); ++i)
+        {
+            key_type value = 0;
+            const bool found = map.find(keys[i], value, 0);
+            agrees = agrees && found == results[i].has_value() && (!found || value == *results[i]);
+        }
+        return agrees;
+    }
+
+    void hits_and_misses()
+    {
+        map_type<> map(16, 1);
+        for (key_type key = 0; key < 5000; key += 2) map.insert({key, key + 1}, 0);
+
+        std::vector<key_type> keys;
+        std::uint64_t x = 88172645463325252ull;
+        for (unsigned i = 0; i < 20000; ++i) keys.push_back(next(x) % 10000);
+
+        const std::vector<std::optional<key_type>> results = lookup_all(map, keys, 0);
+        CRH_CHECK(agrees_with_find(map, keys, results));
+
+        std::size_t hits = 0;
+        for (const std::optional<key_type>& result : results) hits += result.has_value();
+        CRH_CHECK(hits != 0 && hits != keys.size());
+    }
+
+    void stashed_entries()
+    {
+        // Keys 4096 apart share a home bucket, so all but the first few go past the cap into the stash
+        identity_map_type<crh::reclamation::max_displacement<2>> map(4096, 1);
+        const std::size_t buckets = map.bucket_count();
+
+        std::vector<key_type> keys;
+        for (key_type key = 0; key < 8; ++key)
+        {
+            CRH_CHECK(map.insert({key * 4096, key}, 0));
+            keys.push_back(key * 4096);
+        }
+        CRH_CHECK(map.bucket_count() == buckets);
+
+        // And some that share the home without being present
+        for (key_type key = 8; key < 12; ++key) keys.push_back(key * 4096);
+
+        const std::vector<std::optional<key_type>> results = lookup_all(map, keys, 0);
+        CRH_CHECK(agrees_with_find(map, keys, results));
+        for (key_type key = 0; key < 12; ++key) CRH_CHECK(results[key] == (key < 8 ? std::optional<key_type>(key) : std::nullopt));
+    }
+
+    void migration_between_steps()
+    {
+        map_type<crh::reclamation::min_load<15>> map(16, 1);
+        for (key_type key = 0; key < 100; ++key) map.insert({key, key}, 0);
+
+        crh::async::interleaving_scheduler scheduler;
+        std::vector<std::optional<key_type>> results(200);
+        for (key_type key = 0; key < 200; ++key) lookup(map, scheduler, key, 0, results[key]);
+
+        // The table grows several times after the lookups prefetched their home buckets
+        const std::size_t buckets = map.bucket_count();
+        for (unsigned i = 0; i < 100; ++i) scheduler.run_one();
+        for (key_type key = 1000; key < 20000; ++key) map.insert({key, key}, 0);
+        CRH_CHECK(map.bucket_count() > buckets);
+
+        // And shrinks again before they look at their entries
+        for (unsigned i = 0; i < 200; ++i) scheduler.run_one();
+        for (key_type key = 1000; key < 20000; ++key) map.erase(key, 0);
+        scheduler.run();
+
+        for (key_type key = 0; key < 200; ++key)
+            CRH_CHECK(results[key] == (key < 100 ? std::optional<key_type>(key) : std::nullopt));
+    }
+
+    void under_churn()
+    {
+        map_type<crh::reclamation::min_load<15>> map(16, S_OWNERS);
+        const key_type keys = 2000;
+        for (key_type i = 0; i < keys; ++i) map.insert({stable_key(i), i}, 0);
+
+        // Stable keys and keys nobody inserts, looked up while writers grow and shrink the table
+        std::vector<key_type> lookups;
+        for (key_type i = 0; i < 2 * keys; ++i) lookups.push_back(i < keys ? stable_key(i) : stable_key(i) + 4 * keys * S_OWNERS);
+
+        with_churn(map, 20000, [&]
+        {
+            for (unsigned round = 0; round < 10; ++round)
+            {
+                const std::vector<std::optional<key_type>> results = lookup_all(map, lookups, S_WRITERS);
+
+                for (key_type i = 0; i < 2 * keys; ++i)
+                    CRH_CHECK(results[i] == (i < keys ? std::optional<key_type>(i) : std::nullopt));
+            }
+        });
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("hits_and_misses", hits_and_misses);
+    crh::test::run("stashed_entries", stashed_entries);
+    crh::test::run("migration_between_steps", migration_between_steps);
+    crh::test::run("under_churn", under_churn);
+
+    return crh::test::result();
+}
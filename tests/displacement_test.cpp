@@ -0,0 +1,160 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+/**
+ * @brief Tables whose probe distance is capped by the
+ * max_displacement policy, with an overflow stash for entries
+ * that would go past the cap: colliding keys, backward shifts in
+ * capped steps, shrinking held off while entries are stashed,
+ * keys sharing one hash, which no table size separates, keys
+ * sharing only its low bits, which only a huge table would, and
+ * scans and erase_if that report stashed entries exactly once
+ * under writers.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    void displacement_cap()
+    {
+        // Keys 4096 apart share a home bucket, so all but the first few go past the cap into the stash
+        using capped_map = identity_map_type<crh::reclamation::max_displacement<2>, crh::reclamation::min_load<15>>;
+        capped_map map(16, 1);
+
+        // Keys homed in the upper half grow the table to 4096 buckets, above the size it may shrink back to
+        for (key_type key = 2048; key < 4048; ++key) CRH_CHECK(map.insert({key, key}, 0));
+        CRH_CHECK(map.bucket_count() == 4096);
+        const std::size_t buckets = map.bucket_count();
+
+        for (key_type key = 0; key < 8; ++key) CRH_CHECK(map.insert({key * 4096, key}, 0));
+        CRH_CHECK(map.bucket_count() == buckets);
+
+        for (key_type key = 0; key < 8; ++key) CRH_CHECK(map.contains(key * 4096, 0));
+        CRH_CHECK(!map.contains(8 * 4096, 0));
+        CRH_CHECK(count_entries(map) == 2008);
+
+        // A stashed entry keeps the table from shrinking away under it
+        for (key_type key = 2048; key < 4048; ++key) CRH_CHECK(map.erase(key, 0));
+        map.erase_if([](const value_type&) { return false; }, 1);
+        CRH_CHECK(map.bucket_count() == buckets);
+        for (key_type key = 0; key < 8; ++key) CRH_CHECK(map.contains(key * 4096, 0));
+
+        // Erasing a stashed entry finds it as any other, and an empty stash lets the table shrink
+        for (key_type key = 7; key != 0; --key) CRH_CHECK(map.erase(key * 4096, 0) && !map.contains(key * 4096, 0));
+        map.erase_if([](const value_type&) { return false; }, 1);
+        CRH_CHECK(map.bucket_count() < buckets);
+        CRH_CHECK(map.contains(0, 0));
+        CRH_CHECK(count_entries(map) == 1);
+    }
+
+    // Every key hashes alike
+    struct constant_hash
+    {
+        std::size_t operator()(const key_type&) const noexcept { return 0; }
+    };
+
+    void colliding_hashes()
+    {
+        crh::concurrent_robin_map<key_type, key_type, constant_hash, allocator_type, reclaimer_policy,
+            crh::reclamation::max_displacement<4>> map(16, 1);
+
+        // The home bucket, the four after it and the stash fill up; growing would only repeat that
+        key_type placed = 0;
+        try
+        {
+            for (; placed < 1000; ++placed) CRH_CHECK(map.insert({placed, placed}, 0));
+            CRH_CHECK(false);
+        }
+        catch (const std::length_error&) {}
+
+        CRH_CHECK(placed == 64 + 5);
+        CRH_CHECK(map.bucket_count() <= 1024);
+        CRH_CHECK(map.size() == placed);
+        CRH_CHECK(!map.contains(placed, 0));
+        for (key_type key = 0; key < placed; ++key) CRH_CHECK(map.contains(key, 0));
+
+        // A present key is still reported as present, and an erase makes room again
+        CRH_CHECK(!map.insert({0, 0}, 0));
+        CRH_CHECK(map.erase(0, 0));
+        CRH_CHECK(map.insert({placed, placed}, 0));
+        CRH_CHECK(count_entries(map) == placed);
+    }
+
+    void low_bit_collisions()
+    {
+        using capped_map = identity_map_type<crh::reclamation::max_displacement<4>>;
+        capped_map map(16, 1);
+
+        // Distinct hashes sharing their low 40 bits share a home in any table that could be allocated
+        key_type placed = 0;
+        try
+        {
+            for (; placed < 1000; ++placed) CRH_CHECK(map.insert({placed << 40, placed}, 0));
+            CRH_CHECK(false);
+        }
+        catch (const std::length_error&) {}
+
+        CRH_CHECK(placed == 64 + 5);
+        CRH_CHECK(map.bucket_count() <= 1024);
+        for (key_type key = 0; key < placed; ++key) CRH_CHECK(map.contains(key << 40, 0));
+
+        // Keys with homes of their own still go in
+        for (key_type key = 1; key < 100; ++key) CRH_CHECK(map.insert({key, key}, 0));
+        CRH_CHECK(count_entries(map) == placed + 99);
+    }
+
+    void displacement_cap_fixed()
+    {
+        using capped_map = identity_map_type<crh::reclamation::buckets<1024>, crh::reclamation::max_displacement<3>>;
+        std::unique_ptr<capped_map> map = std::make_unique<capped_map>(1);
+
+        // Two keys at home 0 push every key after them past its home, further than the cap
+        CRH_CHECK(map->insert({0, 0}, 0));
+        CRH_CHECK(map->insert({1024, 0}, 0));
+        for (key_type key = 1; key < 500; ++key) CRH_CHECK(map->insert({key, key}, 0));
+
+        // Erasing the head shifts the run back in steps no wider than the cap
+        CRH_CHECK(map->erase(0, 0));
+        for (key_type key = 1; key < 500; ++key) CRH_CHECK(map->contains(key, 0));
+        CRH_CHECK(map->contains(1024, 0));
+        CRH_CHECK(count_entries(*map) == 500);
+
+        // Colliding keys beyond what the stash can hold cannot be placed in a fixed table
+        std::size_t placed = 0;
+        try
+        {
+            for (key_type key = 2; key < 200; ++key)
+            {
+                CRH_CHECK(map->insert({key * 1024, key}, 0));
+                ++placed;
+            }
+            CRH_CHECK(false);
+        }
+        catch (const std::length_error&) {}
+
+        for (key_type key = 2; key < placed + 2; ++key) CRH_CHECK(map->contains(key * 1024, 0));
+        CRH_CHECK(count_entries(*map) == 500 + placed);
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("semantics/max_displacement", semantics<map_type<crh::reclamation::max_displacement<4>>>);
+    crh::test::run("displacement_cap", displacement_cap);
+    crh::test::run("colliding_hashes", colliding_hashes);
+    crh::test::run("low_bit_collisions", low_bit_collisions);
+    crh::test::run("displacement_cap_fixed", displacement_cap_fixed);
+    crh::test::run("owned/max_displacement", owned<map_type<crh::reclamation::max_displacement<3>>>);
+    crh::test::run("scans/max_displacement", churned<map_type<crh::reclamation::max_displacement<3>>, S_SCANS | S_ERASE_IF>);
+    crh::test::run("scans/max_displacement_min_load",
+        churned<map_type<narrow_policy, crh::reclamation::max_displacement<2>, crh::reclamation::min_load<20>>, S_SCANS | S_ERASE_IF>);
+    crh::test::run("scans/buckets_max_displacement",
+        churned<map_type<crh::reclamation::max_displacement<3>, crh::reclamation::buckets<16384>>, S_SCANS | S_ERASE_IF>);
+
+    return crh::test::result();
+}
@@ -0,0 +1,49 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+/**
+ * @brief Parallel erase_if under writers that make the table grow
+ * and shrink: it erases exactly the matching keys nobody else
+ * modifies, and it rejects thread ids past the thread count of
+ * the map.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    void thread_ids()
+    {
+        map_type<> map(16, 4);
+        for (key_type key = 0; key < 1000; ++key) map.insert({key, key}, 0);
+
+        const auto all = [](const value_type&) { return true; };
+
+        bool thrown = false;
+        try { map.erase_if(all, 3, 2); }
+        catch (const std::out_of_range&) { thrown = true; }
+        CRH_CHECK(thrown);
+
+        thrown = false;
+        try { map.parallel_for_each(5, 0, [](const value_type&) {}); }
+        catch (const std::out_of_range&) { thrown = true; }
+        CRH_CHECK(thrown);
+
+        // Nothing was erased by the rejected call
+        CRH_CHECK(map.size() == 1000);
+        CRH_CHECK(map.erase_if(all, 2, 2) == 1000);
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("erase_if/default", churned<map_type<>, S_ERASE_IF>);
+    crh::test::run("erase_if/narrow_kcas", churned<map_type<narrow_policy>, S_ERASE_IF>);
+    crh::test::run("erase_if/buckets", churned<map_type<crh::reclamation::buckets<16384>>, S_ERASE_IF>);
+    crh::test::run("thread_ids", thread_ids);
+
+    return crh::test::result();
+}
@@ -0,0 +1,146 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Tables whose capacity is fixed by the buckets policy:
+ * the sizes they may be constructed with, the load they stop
+ * at, alone and under concurrent inserts, erases from a full
+ * table, and backward shifts too wide for one kCAS, which
+ * erases take in steps.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    template< class Map >
+    void fixed_semantics()
+    {
+        std::unique_ptr<Map> map = std::make_unique<Map>(1);
+        check_semantics(*map, 2000);
+        CRH_CHECK(map->bucket_count() == Map::buckets);
+    }
+
+    void sized_construction()
+    {
+        using fixed_map = map_type<crh::reclamation::buckets<1024>>;
+
+        // A size the fixed table holds is accepted, one past it is rejected up front
+        std::unique_ptr<fixed_map> map = std::make_unique<fixed_map>(640, 1);
+        CRH_CHECK(map->bucket_count() == 1024);
+
+        bool thrown = false;
+        try { map = std::make_unique<fixed_map>(641, 1); }
+        catch (const std::invalid_argument&) { thrown = true; }
+        CRH_CHECK(thrown);
+    }
+
+    void fixed_capacity()
+    {
+        using fixed_map = map_type<crh::reclamation::buckets<4096>>;
+        std::unique_ptr<fixed_map> map = std::make_unique<fixed_map>(1);
+
+        // A fixed table fills up to five eighths of its buckets, then refuses new keys
+        key_type key = 0;
+        try
+        {
+            for (; key < 4096; ++key) map->insert({key, key}, 0);
+            CRH_CHECK(false);
+        }
+        catch (const std::length_error&) {}
+
+        CRH_CHECK(map->size() == key);
+        CRH_CHECK(key == 5 * 4096 / 8);
+        CRH_CHECK(map->bucket_count() == 4096);
+
+        // A present key is still reported as present rather than as a full table
+        CRH_CHECK(!map->insert({0, 0}, 0));
+
+        // Erasing from a full table never needs space, and frees room for new keys
+        for (key_type k = 0; k < key; k += 2) CRH_CHECK(map->erase(k, 0));
+        for (key_type k = 0; k < key; ++k) CRH_CHECK(map->contains(k, 0) == (k % 2 == 1));
+        for (key_type k = 0; k < key; k += 2) CRH_CHECK(map->insert({k, k}, 0));
+        CRH_CHECK(map->size() == key);
+        CRH_CHECK(count_entries(*map) == key);
+    }
+
+    // Writers racing for the last free room take exactly the capacity between them
+    void concurrent_fill()
+    {
+        using fixed_map = map_type<crh::reclamation::buckets<4096>>;
+        std::unique_ptr<fixed_map> map = std::make_unique<fixed_map>(S_OWNERS);
+
+        for (unsigned round = 0; round < 20; ++round)
+        {
+            std::vector<std::size_t> inserted(S_OWNERS, 0);
+            std::vector<std::thread> writers;
+
+            for (unsigned t = 0; t < S_OWNERS; ++t)
+            {
+                writers.emplace_back([&, t]
+                {
+                    try
+                    {
+                        for (key_type i = 0; i < 4096; ++i)
+                            if (map->insert({i * S_OWNERS + t, i}, t)) ++inserted[t];
+                    }
+                    catch (const std::length_error&) {}
+                });
+            }
+
+            for (std::thread& writer : writers) writer.join();
+
+            std::size_t total = 0;
+            for (const std::size_t count : inserted) total += count;
+
+            CRH_CHECK(total == 5 * 4096 / 8);
+            CRH_CHECK(map->size() == total);
+            CRH_CHECK(count_entries(*map) == total);
+
+            CRH_CHECK(map->erase_if([](const value_type&) { return true; }, 1, 0) == total);
+        }
+    }
+
+    void wide_backward_shift()
+    {
+        using narrow_map = identity_map_type<narrow_policy, crh::reclamation::buckets<1024>>;
+        std::unique_ptr<narrow_map> map = std::make_unique<narrow_map>(1);
+
+        // Two keys at home 0 push every key after them one bucket past its home
+        CRH_CHECK(map->insert({0, 0}, 0));
+        CRH_CHECK(map->insert({1024, 0}, 0));
+        for (key_type key = 1; key < 500; ++key) CRH_CHECK(map->insert({key, key}, 0));
+
+        // Erasing the head shifts the whole run back, far more entries than one kCAS takes
+        CRH_CHECK(map->erase(0, 0));
+        for (key_type key = 1; key < 500; ++key) CRH_CHECK(map->contains(key, 0));
+        CRH_CHECK(map->contains(1024, 0) && !map->contains(0, 0));
+        CRH_CHECK(count_entries(*map) == 500);
+    }
+
+    template< class Map >
+    void owned_fixed()
+    {
+        std::unique_ptr<Map> map = std::make_unique<Map>(S_OWNERS);
+        owned_keys(*map, 1500, 100000);
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("semantics/buckets", fixed_semantics<map_type<crh::reclamation::buckets<8192>>>);
+    crh::test::run("sized_construction", sized_construction);
+    crh::test::run("fixed_capacity", fixed_capacity);
+    crh::test::run("concurrent_fill", concurrent_fill);
+    crh::test::run("wide_backward_shift", wide_backward_shift);
+    crh::test::run("owned/buckets", owned_fixed<map_type<crh::reclamation::buckets<16384>>>);
+    crh::test::run("owned/narrow_kcas", owned<map_type<narrow_policy>>);
+
+    return crh::test::result();
+}
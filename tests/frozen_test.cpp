@@ -0,0 +1,130 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "crh/detail/frozen_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Frozen copies of a map: every key found with its value,
+ * none found that was not copied, including keys with long
+ * displacement runs, maps built straight from a range, moved
+ * into another, and builds whose copies throw, which must not
+ * leave values behind.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    void frozen_lookups()
+    {
+        map_type<> map(16, 1);
+        for (key_type key = 0; key < 50000; ++key) map.insert({key * 7, key}, 0);
+
+        const map_type<>::frozen_map frozen = map.freeze(0);
+        CRH_CHECK(frozen.size() == 50000);
+
+        for (key_type key = 0; key < 7 * 50000; ++key)
+        {
+            const auto* entry = frozen.find(key);
+            CRH_CHECK((entry != nullptr) == (key % 7 == 0));
+            if (entry) CRH_CHECK(entry->second == key / 7);
+        }
+
+        std::size_t visited = 0;
+        frozen.for_each([&visited](const value_type&) { ++visited; });
+        CRH_CHECK(visited == 50000);
+
+        // Long displacement runs from colliding homes
+        identity_map_type<> clustered(16, 1);
+        for (key_type key = 0; key < 100; ++key) clustered.insert({key * 1024, key}, 0);
+        for (key_type key = 0; key < 3000; ++key) clustered.insert({key, key}, 0);
+
+        const identity_map_type<>::frozen_map frozen_clustered = clustered.freeze(0);
+        for (key_type key = 0; key < 200000; ++key)
+            CRH_CHECK(frozen_clustered.contains(key) == (key < 3000 || (key % 1024 == 0 && key / 1024 < 100)));
+
+        key_type value = 0;
+        CRH_CHECK(frozen_clustered.find(5 * 1024, value) && value == 5);
+    }
+
+    void from_range()
+    {
+        std::vector<std::pair<std::string, int>> values;
+        for (int i = 0; i < 1000; ++i) values.emplace_back(std::to_string(i % 600), i);
+
+        const crh::frozen_robin_map<std::string, int> frozen(values.begin(), values.end());
+        CRH_CHECK(frozen.size() == 600);
+
+        int value = 0;
+        CRH_CHECK(frozen.find("599", value) && value == 599);
+        CRH_CHECK(!frozen.contains("600"));
+    }
+
+    void move_assignment()
+    {
+        std::vector<std::pair<int, int>> small, large;
+        for (int i = 0; i < 10; ++i) small.emplace_back(i, i);
+        for (int i = 0; i < 1000; ++i) large.emplace_back(i, -i);
+
+        crh::frozen_robin_map<int, int> frozen(small.begin(), small.end());
+        crh::frozen_robin_map<int, int> other(large.begin(), large.end());
+
+        frozen = std::move(other);
+        CRH_CHECK(frozen.size() == 1000);
+
+        int value = 0;
+        CRH_CHECK(frozen.find(999, value) && value == -999);
+        CRH_CHECK(!frozen.contains(1000));
+        CRH_CHECK(other.size() == 0);
+    }
+
+    // Counts its live copies, and throws instead of making one once told to
+    struct counted
+    {
+        static int live, copies_left;
+
+        counted() { ++live; }
+
+        counted(const counted&)
+        {
+            if (copies_left-- == 0) throw std::runtime_error("copy");
+            ++live;
+        }
+
+        ~counted() { --live; }
+    };
+
+    int counted::live = 0, counted::copies_left = 0;
+
+    void throwing_build()
+    {
+        std::vector<std::pair<int, counted>> values(1000);
+        for (int i = 0; i < 1000; ++i) values[i].first = i;
+
+        counted::copies_left = 500;
+        try
+        {
+            crh::frozen_robin_map<int, counted> frozen(values.begin(), values.end());
+            CRH_CHECK(false);
+        }
+        catch (const std::runtime_error&) {}
+
+        // Only the source values are left
+        CRH_CHECK(counted::live == 1000);
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("frozen_lookups", frozen_lookups);
+    crh::test::run("from_range", from_range);
+    crh::test::run("move_assignment", move_assignment);
+    crh::test::run("throwing_build", throwing_build);
+
+    return crh::test::result();
+}
@@ -0,0 +1,51 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Weakly consistent iteration and parallel_for_each: under
+ * writers that make the table grow, every key nobody modifies is
+ * reported exactly once. These maps never shrink; scans across
+ * shrinking tables are in shrink_test.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    void parallel_for_each()
+    {
+        map_type<> map(16, S_OWNERS + 2);
+        const key_type keys = 5000;
+        for (key_type i = 0; i < keys; ++i) map.insert({stable_key(i), i}, 0);
+
+        with_churn(map, 20000, [&]
+        {
+            for (unsigned round = 0; round < 10; ++round)
+            {
+                std::vector<std::atomic<unsigned>> seen(keys);
+                map.parallel_for_each(3, S_WRITERS, [&seen](const value_type& kv)
+                {
+                    if (is_stable(kv.first)) seen[kv.first / S_OWNERS].fetch_add(1);
+                });
+
+                std::size_t wrong = 0;
+                for (const std::atomic<unsigned>& count : seen) if (count.load() != 1) ++wrong;
+                CRH_CHECK(wrong == 0);
+            }
+        });
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("scans/default", churned<map_type<>>);
+    crh::test::run("scans/narrow_kcas", churned<map_type<narrow_policy>>);
+    crh::test::run("scans/buckets", churned<map_type<crh::reclamation::buckets<16384>>>);
+    crh::test::run("parallel_for_each", parallel_for_each);
+
+    return crh::test::result();
+}
@@ -0,0 +1,24 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "crh/detail/kcas/harris_kcas.hpp"
+#include "test_maps.hpp"
+
+/**
+ * @brief The map on the Harris, Fraser and Pratt kCAS, whose
+ * descriptors are retired to the memory reclaimer, alone and
+ * under concurrent writers.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    using harris_policy = crh::reclamation::kcas<crh::harris_kcas<allocator_type, crh::reclamation::epoch_reclaimer>>;
+} // namespace
+
+int main()
+{
+    crh::test::run("semantics/harris_kcas", semantics<map_type<harris_policy>>);
+    crh::test::run("owned/harris_kcas", owned<map_type<harris_policy>>);
+
+    return crh::test::result();
+}
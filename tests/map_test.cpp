@@ -0,0 +1,123 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/**
+ * @brief concurrent_robin_map with the default policies and with
+ * memoized hashes, checked against a reference on one thread and
+ * under writers on keys of their own, next to keys nobody
+ * modifies. The other policies have tests of their own.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    // Counts its calls, so a test can tell when keys are hashed again
+    struct counting_hash
+    {
+        static std::atomic<std::size_t> calls;
+
+        std::size_t operator()(const key_type& key) const noexcept
+        {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            return crh::hash::hash<key_type>()(key);
+        }
+    };
+
+    std::atomic<std::size_t> counting_hash::calls{0};
+
+    template< class... Policies >
+    using counting_map_type = crh::concurrent_robin_map<key_type, key_type, counting_hash,
+        allocator_type, reclaimer_policy, Policies...>;
+
+    /**
+     * @brief With memoized hashes each key is hashed once, by
+     * its insert, however often the table grows afterwards
+     *
+     */
+    void memoized_growth()
+    {
+        counting_map_type<crh::reclamation::memoize_hash<true>> map(16, 1);
+        const std::size_t buckets = map.bucket_count();
+
+        counting_hash::calls.store(0);
+        for (key_type key = 0; key < 20000; ++key) CRH_CHECK(map.insert({key, key}, 0));
+
+        CRH_CHECK(map.bucket_count() > buckets);
+        CRH_CHECK(counting_hash::calls.load() == 20000);
+
+        // Without memoized hashes every move to a larger table hashes the keys again
+        counting_map_type<> plain(16, 1);
+
+        counting_hash::calls.store(0);
+        for (key_type key = 0; key < 20000; ++key) CRH_CHECK(plain.insert({key, key}, 0));
+
+        CRH_CHECK(counting_hash::calls.load() > 20000);
+    }
+
+    void string_keys()
+    {
+        crh::concurrent_robin_map<std::string, int, crh::hash::hash<std::string>,
+            std::allocator<std::pair<const std::string, int>>, reclaimer_policy> map(16, 1);
+
+        for (int i = 0; i < 1000; ++i) CRH_CHECK(map.insert({std::to_string(i), i}, 0));
+        CRH_CHECK(!map.insert({"10", 0}, 0));
+
+        int value = 0;
+        CRH_CHECK(map.find("999", value, 0) && value == 999);
+        CRH_CHECK(!map.contains("1000", 0));
+        CRH_CHECK(map.erase("500", 0) && !map.erase("500", 0));
+        CRH_CHECK(map.size() == 999);
+    }
+
+    void seeded_string_hash()
+    {
+        const crh::hash::hash<std::string> first(1), second(2), also_first(1);
+        const std::string key = "a key long enough to take the block loop of the byte hash";
+
+        // The seed picks the hashes, and the default hashers of one process agree
+        CRH_CHECK(first(key) == also_first(key) && first(key) != second(key));
+        CRH_CHECK(crh::hash::hash<std::string>()(key) == crh::hash::hash<std::string_view>()(key));
+
+        crh::concurrent_robin_map<std::string, int, crh::hash::hash<std::string>,
+            std::allocator<std::pair<const std::string, int>>, reclaimer_policy, crh::reclamation::hash_seed<42>> map(16, 1);
+
+        for (int i = 0; i < 1000; ++i) CRH_CHECK(map.insert({std::to_string(i), i}, 0));
+        for (int i = 0; i < 1000; ++i) CRH_CHECK(map.contains(std::to_string(i), 0));
+        CRH_CHECK(!map.contains("1000", 0));
+    }
+
+    // Descriptor pointers name at most 256 threads, so a map for more is refused rather than built
+    void thread_limit()
+    {
+        map_type<> widest(16, 256);
+        CRH_CHECK(widest.insert({1, 1}, 255));
+
+        bool threw = false;
+        try { map_type<> too_wide(16, 257); }
+        catch (const std::invalid_argument&) { threw = true; }
+        CRH_CHECK(threw);
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("semantics/default", semantics<map_type<>>);
+    crh::test::run("semantics/memoize_hash", semantics<map_type<crh::reclamation::memoize_hash<true>>>);
+    crh::test::run("semantics/string_keys", string_keys);
+    crh::test::run("seeded_string_hash", seeded_string_hash);
+    crh::test::run("memoized_growth", memoized_growth);
+    crh::test::run("thread_limit", thread_limit);
+    crh::test::run("owned/default", owned<map_type<>>);
+    crh::test::run("owned/memoize_hash", owned<map_type<crh::reclamation::memoize_hash<true>>>);
+
+    return crh::test::result();
+}
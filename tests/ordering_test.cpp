@@ -0,0 +1,81 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The acquire/release ordering checked against the
+ * sequentially consistent reference. Alone, the same operations
+ * must give the same results and leave the same entries; under
+ * writers on keys of their own, whose outcomes do not depend on
+ * the interleaving, every operation must have the outcome it has
+ * under the reference.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    using acq_rel_policy = crh::reclamation::ordering<crh::ordering::acquire_release>;
+
+    /**
+     * @brief The same operations give the same results and leave
+     * the same entries under acquire/release as under the
+     * sequentially consistent reference
+     *
+     */
+    void same_results()
+    {
+        map_type<> reference(16, 1);
+        map_type<acq_rel_policy> relaxed(16, 1);
+
+        std::uint64_t x = 2463534242ull;
+        for (std::size_t i = 0; i < 200000; ++i)
+        {
+            const key_type key = next(x) % 20000;
+            switch ((x >> 32) % 3)
+            {
+            case 0: CRH_CHECK(reference.insert({key, i}, 0) == relaxed.insert({key, i}, 0)); break;
+            case 1: CRH_CHECK(reference.erase(key, 0) == relaxed.erase(key, 0)); break;
+            default: CRH_CHECK(reference.contains(key, 0) == relaxed.contains(key, 0));
+            }
+        }
+
+        CRH_CHECK(reference.size() == relaxed.size());
+        CRH_CHECK(reference.bucket_count() == relaxed.bucket_count());
+
+        for (auto it = reference.begin(0); it != reference.end(); ++it)
+        {
+            key_type value = 0;
+            CRH_CHECK(relaxed.find(it->first, value, 0) && value == it->second);
+        }
+    }
+
+    /**
+     * @brief The acquire/release ordering gives every operation the
+     * outcome the sequentially consistent reference gives it
+     *
+     */
+    void same_outcomes()
+    {
+        map_type<> reference(16, S_OWNERS);
+        map_type<acq_rel_policy> relaxed(16, S_OWNERS);
+
+        const std::vector<std::vector<bool>> expected = owned_keys(reference, 2000, 100000);
+        const std::vector<std::vector<bool>> outcomes = owned_keys(relaxed, 2000, 100000);
+
+        CRH_CHECK(outcomes == expected);
+        CRH_CHECK(relaxed.size() == reference.size());
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("semantics/acquire_release", semantics<map_type<acq_rel_policy>>);
+    crh::test::run("owned/acquire_release", owned<map_type<acq_rel_policy>>);
+    crh::test::run("same_results", same_results);
+    crh::test::run("same_outcomes", same_outcomes);
+
+    return crh::test::result();
+}
@@ -0,0 +1,75 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_maps.hpp"
+
+#include <cstdint>
+
+/**
+ * @brief Shrinking by cooperative migration once the load falls
+ * below the min_load policy: after mass erases, after erase_if,
+ * and under scans that must not lose or repeat entries while the
+ * table moves. Without the policy, or at the size it was
+ * constructed with, the table keeps its buckets.
+ *
+ */
+namespace
+{
+    using namespace crh::test;
+
+    void shrink_after_mass_erase()
+    {
+        map_type<crh::reclamation::min_load<15>> map(16, 1);
+        const std::size_t initial = map.bucket_count();
+
+        for (key_type key = 0; key < 100000; ++key) map.insert({key, key}, 0);
+        const std::size_t grown = map.bucket_count();
+        CRH_CHECK(grown > initial);
+
+        for (key_type key = 1000; key < 100000; ++key) CRH_CHECK(map.erase(key, 0));
+        CRH_CHECK(map.bucket_count() < grown);
+
+        for (key_type key = 0; key < 100000; ++key) CRH_CHECK(map.contains(key, 0) == (key < 1000));
+        CRH_CHECK(count_entries(map) == 1000);
+
+        // erase_if shrinks once it is done as well
+        const std::size_t before = map.bucket_count();
+        for (key_type key = 1000; key < 50000; ++key) map.insert({key, key}, 0);
+        CRH_CHECK(map.bucket_count() > before);
+
+        CRH_CHECK(map.erase_if([](const value_type& kv) { return kv.first >= 10; }, 1) == 49990);
+        CRH_CHECK(map.bucket_count() <= before);
+        CRH_CHECK(count_entries(map) == 10);
+    }
+
+    void shrink_floor()
+    {
+        // Shrinking is opt in
+        map_type<> plain(16, 1);
+        for (key_type key = 0; key < 100000; ++key) plain.insert({key, key}, 0);
+        const std::size_t grown = plain.bucket_count();
+
+        for (key_type key = 0; key < 100000; ++key) CRH_CHECK(plain.erase(key, 0));
+        plain.erase_if([](const value_type&) { return false; }, 1);
+        CRH_CHECK(plain.bucket_count() == grown);
+
+        // And stops at the size asked for on construction
+        map_type<crh::reclamation::min_load<15>> sized(4096, 1);
+        const std::size_t initial = sized.bucket_count();
+
+        for (key_type key = 0; key < 100000; ++key) sized.insert({key, key}, 0);
+        CRH_CHECK(sized.bucket_count() > initial);
+
+        for (key_type key = 0; key < 100000; ++key) CRH_CHECK(sized.erase(key, 0));
+        sized.erase_if([](const value_type&) { return false; }, 1);
+        CRH_CHECK(sized.bucket_count() == initial);
+    }
+} // namespace
+
+int main()
+{
+    crh::test::run("semantics/min_load", semantics<map_type<crh::reclamation::min_load<25>>>);
+    crh::test::run("shrink_after_mass_erase", shrink_after_mass_erase);
+    crh::test::run("shrink_floor", shrink_floor);
+    crh::test::run("scans/min_load", churned<map_type<crh::reclamation::min_load<20>>>);
+
+    return crh::test::result();
+}
@@ -0,0 +1,388 @@
+#ifndef CRH_TEST_MAPS_HPP
+#define CRH_TEST_MAPS_HPP
+
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Maps and workloads shared by the tests. Workloads check
+ * every outcome against what is known to be in the map: writers
+ * own the keys equal to their id modulo S_OWNERS, and the keys of
+ * the last residue, the stable keys, belong to nobody.
+ *
+ */
+namespace crh
+{
+namespace test
+{
+    using key_type = std::uint64_t;
+    using value_type = std::pair<const key_type, key_type>;
+    using allocator_type = std::allocator<value_type>;
+    using reclaimer_policy = crh::reclamation::reclaimer<crh::reclamation::epoch_reclaimer>;
+
+    template< class... Policies >
+    using map_type = crh::concurrent_robin_map<key_type, key_type, crh::hash::hash<key_type>,
+        allocator_type, reclaimer_policy, Policies...>;
+
+    // Leaves keys as they are, so tests can choose where keys land and collide
+    struct identity_hash
+    {
+        std::size_t operator()(const key_type& key) const noexcept { return static_cast<std::size_t>(key); }
+    };
+
+    template< class... Policies >
+    using identity_map_type = crh::concurrent_robin_map<key_type, key_type, identity_hash,
+        allocator_type, reclaimer_policy, Policies...>;
+
+    // A kCAS too narrow for long backward shifts, so erases take them in steps
+    template< class Allocator, class MemReclaimer >
+    struct narrow_kcas : crh::brown_kcas<Allocator, MemReclaimer>
+    {
+        static constexpr std::size_t S_MAX_ENTRIES = 16;
+
+        using crh::brown_kcas<Allocator, MemReclaimer>::brown_kcas;
+    };
+
+    using narrow_policy = crh::reclamation::kcas<narrow_kcas<allocator_type, crh::reclamation::epoch_reclaimer>>;
+
+    static constexpr unsigned S_WRITERS = 3, S_OWNERS = 4;
+
+    // The workloads of churned(), to be combined
+    static constexpr unsigned S_SCANS = 0x1, S_ERASE_IF = 0x2;
+
+    inline
+    key_type stable_key(const key_type& i) noexcept { return i * S_OWNERS + S_WRITERS; }
+
+    inline
+    bool is_stable(const key_type& key) noexcept { return key % S_OWNERS == S_WRITERS; }
+
+    inline
+    std::uint64_t next(std::uint64_t& x) noexcept
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    }
+
+    template< class Map >
+    std::size_t count_entries(Map& map)
+    {
+        std::size_t count = 0;
+        for (auto it = map.begin(0); it != map.end(); ++it) ++count;
+        return count;
+    }
+
+    /**
+     * @brief Checks the map against a reference over a random
+     * mix of operations on one thread, including enough keys to
+     * grow the table
+     *
+     */
+    template< class Map >
+    void check_semantics(Map& map, const key_type& keys)
+    {
+        std::unordered_map<key_type, key_type> reference;
+        std::uint64_t x = 88172645463325252ull;
+
+        for (std::size_t i = 0; i < 20 * keys; ++i)
+        {
+            const key_type key = next(x) % keys;
+            key_type value = 0;
+
+            switch ((x >> 32) % 5)
+            {
+            case 0:
+                CRH_CHECK(map.insert({key, i}, 0) == reference.emplace(key, i).second);
+                break;
+            case 1:
+                CRH_CHECK(map.try_emplace(0, key, i) == reference.emplace(key, i).second);
+                break;
+            case 2:
+                CRH_CHECK(map.erase(key, 0) == (reference.erase(key) == 1));
+                break;
+            case 3:
+                CRH_CHECK(map.contains(key, 0) == (reference.count(key) == 1));
+                break;
+            default:
+                if (map.find(key, value, 0))
+                {
+                    CRH_CHECK(reference.count(key) == 1);
+                    CRH_CHECK(value == reference[key]);
+                }
+                else CRH_CHECK(reference.count(key) == 0);
+            }
+        }
+
+        CRH_CHECK(map.size() == reference.size());
+
+        std::unordered_set<key_type> seen;
+        for (auto it = map.begin(0); it != map.end(); ++it)
+        {
+            CRH_CHECK(seen.insert(it->first).second);
+            CRH_CHECK(reference.count(it->first) == 1 && reference[it->first] == it->second);
+        }
+        CRH_CHECK(seen.size() == reference.size());
+
+        for (const auto& key_value : reference) CRH_CHECK(map.erase(key_value.first, 0));
+        CRH_CHECK(map.size() == 0);
+        CRH_CHECK(count_entries(map) == 0);
+    }
+
+    template< class Map >
+    void semantics()
+    {
+        Map map(16, 1);
+        check_semantics(map, 5000);
+    }
+
+    /**
+     * @brief Random operations on the keys a writer owns,
+     * checked against the keys it knows to be present. A fixed
+     * table may refuse an insert once full
+     *
+     * @return The outcome of every operation
+     */
+    template< class Map >
+    std::vector<bool> own_keys(Map& map, const unsigned thread_id, const key_type& keys, const std::size_t& ops)
+    {
+        std::vector<bool> outcomes;
+        outcomes.reserve(ops);
+
+        std::unordered_set<key_type> mine;
+        std::uint64_t x = 88172645463325252ull + thread_id;
+
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            const key_type key = (next(x) % keys) * S_OWNERS + thread_id;
+            bool outcome = false;
+
+            switch ((x >> 32) % 3)
+            {
+            case 0:
+                try
+                {
+                    outcome = map.insert({key, key}, thread_id);
+                    CRH_CHECK(outcome == (mine.count(key) == 0));
+                    mine.insert(key);
+                }
+                catch (const std::length_error&)
+                {
+                    CRH_CHECK(mine.count(key) == 0);
+                    CRH_CHECK(!map.contains(key, thread_id));
+                }
+                break;
+            case 1:
+                outcome = map.erase(key, thread_id);
+                CRH_CHECK(outcome == (mine.erase(key) == 1));
+                break;
+            default:
+            {
+                key_type value = 0;
+                outcome = map.find(key, value, thread_id);
+                CRH_CHECK(outcome == (mine.count(key) == 1));
+                if (outcome) CRH_CHECK(value == key);
+            }
+            }
+
+            outcomes.push_back(outcome);
+        }
+
+        for (const key_type key : mine) CRH_CHECK(map.contains(key, thread_id));
+        return outcomes;
+    }
+
+    /**
+     * @brief Writers on keys of their own, sharing the map with
+     * stable keys, which must stay visible throughout. The map
+     * needs S_OWNERS thread ids
+     *
+     * @return The outcomes of each writer
+     */
+    template< class Map >
+    std::vector<std::vector<bool>> owned_keys(Map& map, const key_type& keys, const std::size_t& ops)
+    {
+        for (key_type i = 0; i < keys; ++i) map.insert({stable_key(i), i}, 0);
+
+        std::vector<std::vector<bool>> outcomes(S_WRITERS);
+        std::vector<std::thread> writers;
+
+        for (unsigned t = 0; t < S_WRITERS; ++t)
+        {
+            writers.emplace_back([&, t]
+            {
+                outcomes[t] = own_keys(map, t, keys, ops);
+
+                for (key_type i = t; i < keys; i += S_WRITERS) CRH_CHECK(map.contains(stable_key(i), t));
+            });
+        }
+
+        for (std::thread& writer : writers) writer.join();
+
+        for (key_type i = 0; i < keys; ++i) CRH_CHECK(map.contains(stable_key(i), 0));
+        CRH_CHECK(count_entries(map) == map.size());
+
+        return outcomes;
+    }
+
+    template< class Map >
+    void owned()
+    {
+        Map map(16, S_OWNERS);
+        owned_keys(map, 2000, 100000);
+    }
+
+    /**
+     * @brief Runs a function on the calling thread while the
+     * writers fill and empty their keys in bursts, so a table
+     * that can resize grows and shrinks under it. The function
+     * may use thread id S_WRITERS
+     *
+     */
+    template< class Map, class F >
+    void with_churn(Map& map, const key_type& burst, F&& f)
+    {
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> writers;
+
+        for (unsigned t = 0; t < S_WRITERS; ++t)
+        {
+            writers.emplace_back([&, t]
+            {
+                while (!stop.load())
+                {
+                    for (key_type i = 0; i < burst && !stop.load(); ++i)
+                    {
+                        try { map.insert({i * S_OWNERS + t, i}, t); }
+                        catch (const std::length_error&) {}
+                    }
+                    for (key_type i = 0; i < burst; ++i) map.erase(i * S_OWNERS + t, t);
+                }
+            });
+        }
+
+        f();
+
+        stop.store(true);
+        for (std::thread& writer : writers) writer.join();
+    }
+
+    /**
+     * @brief Number of stable keys below keys that a scan did
+     * not report exactly the expected number of times
+     *
+     */
+    template< class Expected >
+    std::size_t wrong_counts(const std::unordered_map<key_type, unsigned>& seen, const key_type& keys, Expected&& expected)
+    {
+        std::size_t wrong = 0;
+        for (key_type i = 0; i < keys; ++i)
+        {
+            const auto found = seen.find(stable_key(i));
+            if ((found == seen.end() ? 0 : found->second) != expected(i)) ++wrong;
+        }
+        return wrong;
+    }
+    /**
+     * @brief Scans from thread id S_WRITERS while the writers
+     * churn, each scan reporting every stable key exactly once.
+     * A table that can resize must have grown between the scans
+     *
+     */
+    template< class Map >
+    void stable_scans(Map& map, const key_type& keys, const key_type& burst, const unsigned& scans)
+    {
+        for (key_type i = 0; i < keys; ++i) map.insert({stable_key(i), i}, 0);
+
+        std::size_t smallest = map.bucket_count(), largest = smallest;
+
+        with_churn(map, burst, [&]
+        {
+            for (unsigned scan = 0; scan < scans; ++scan)
+            {
+                std::unordered_map<key_type, unsigned> seen;
+                for (auto it = map.begin(S_WRITERS); it != map.end(); ++it)
+                    if (is_stable(it->first)) ++seen[it->first];
+
+                CRH_CHECK(wrong_counts(seen, keys, [](const key_type&) { return 1u; }) == 0);
+
+                smallest = std::min(smallest, map.bucket_count());
+                largest = std::max(largest, map.bucket_count());
+            }
+        });
+
+        if (Map::buckets == 0) CRH_CHECK(smallest < largest);
+        for (key_type i = 0; i < keys; ++i) CRH_CHECK(map.contains(stable_key(i), 0));
+    }
+
+    /**
+     * @brief erase_if from thread ids S_WRITERS up while the
+     * writers churn. Each round erases the even stable keys,
+     * which must be all it erases, and puts them back. The map
+     * needs S_OWNERS + 1 thread ids
+     *
+     */
+    template< class Map >
+    void stable_erase_if(Map& map, const key_type& keys, const key_type& burst, const unsigned& rounds)
+    {
+        for (key_type i = 0; i < keys; ++i) map.insert({stable_key(i), i}, 0);
+
+        with_churn(map, burst, [&]
+        {
+            for (unsigned round = 0; round < rounds; ++round)
+            {
+                const std::size_t erased = map.erase_if([](const value_type& kv)
+                {
+                    return is_stable(kv.first) && (kv.first / S_OWNERS) % 2 == 0;
+                }, 1 + round % 2, S_WRITERS);
+
+                CRH_CHECK(erased == (keys + 1) / 2);
+                for (key_type i = 0; i < keys; ++i) CRH_CHECK(map.contains(stable_key(i), S_WRITERS) == (i % 2 == 1));
+
+                for (key_type i = 0; i < keys; i += 2) CRH_CHECK(map.insert({stable_key(i), i}, S_WRITERS));
+            }
+        });
+
+        for (key_type i = 0; i < keys; ++i) CRH_CHECK(map.contains(stable_key(i), 0));
+
+        const std::size_t before = map.size();
+        CRH_CHECK(map.erase_if([](const value_type&) { return true; }, 2, 0) == before);
+        CRH_CHECK(map.size() == 0);
+        CRH_CHECK(map.begin(0) == map.end());
+    }
+
+    /**
+     * @brief Runs the chosen churn workloads on a new map: one
+     * that grows from 16 buckets, or a fixed one, held on the heap
+     * for its inline buckets and churned in smaller bursts. The
+     * map gets S_OWNERS + 1 thread ids
+     *
+     */
+    template< class Map, unsigned Workloads = S_SCANS >
+    void churned()
+    {
+        constexpr bool fixed = Map::buckets != 0;
+        const key_type keys = fixed ? 2000 : 3000, burst = fixed ? 1000 : 20000;
+
+        std::unique_ptr<Map> map;
+        if constexpr (fixed) map = std::make_unique<Map>(S_OWNERS + 1);
+        else map = std::make_unique<Map>(16, S_OWNERS + 1);
+
+        if constexpr ((Workloads & S_SCANS) != 0) stable_scans(*map, keys, burst, 40);
+        if constexpr ((Workloads & S_ERASE_IF) != 0) stable_erase_if(*map, keys, burst, 10);
+    }
+} // namespace test
+} // namespace crh
+
+#endif // !CRH_TEST_MAPS_HPP
@@ -0,0 +1,54 @@
+#ifndef CRH_TEST_UTILS_HPP
+#define CRH_TEST_UTILS_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+namespace crh
+{
+namespace test
+{
+    inline
+    std::atomic<unsigned>& failures() noexcept
+    {
+        static std::atomic<unsigned> count{0};
+        return count;
+    }
+
+    /**
+     * @brief Reports a failed check and counts it, so a test
+     * goes on to report every failure it finds. Safe to call
+     * from any thread
+     *
+     */
+    inline
+    void check(const bool passed, const char* expression, const char* file, const int line) noexcept
+    {
+        if (passed) return;
+
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        failures().fetch_add(1);
+    }
+
+    /**
+     * @brief Runs a named case and reports how it went
+     *
+     */
+    template< class F >
+    void run(const char* name, F&& f)
+    {
+        const unsigned before = failures().load();
+        f();
+        std::printf("%-40s %s\n", name, failures().load() == before ? "passed" : "FAILED");
+        std::fflush(stdout);
+    }
+
+    inline
+    int result() noexcept { return failures().load() == 0 ? EXIT_SUCCESS : EXIT_FAILURE; }
+} // namespace test
+} // namespace crh
+
+#define CRH_CHECK(expression) crh::test::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#endif // !CRH_TEST_UTILS_HPP
@@ -0,0 +1,244 @@
+#include "crh/detail/concurrent_robin_map.hpp"
+#include "replay.hpp"
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Records traces of a map and loads them back: every
+ * operation of an open trace appears once with its outcome, in
+ * order within its thread, replays into other maps with the
+ * outcomes of the capture, and a trace that cannot be written
+ * reports it on close without holding up the map.
+ *
+ * Usage: trace_test directory
+ *
+ */
+namespace
+{
+    using key_type = std::uint64_t;
+    using reclaimer_policy = crh::reclamation::reclaimer<crh::reclamation::epoch_reclaimer>;
+
+    // Small rings, so recording threads wait on a full ring now and then
+    using map_type = crh::concurrent_robin_map<key_type, key_type, crh::hash::hash<key_type>,
+        std::allocator<std::pair<const key_type, key_type>>, reclaimer_policy,
+        crh::reclamation::trace<crh::trace::ring_recorder<256>>>;
+
+    using string_map_type = crh::concurrent_robin_map<std::string, int, crh::hash::hash<std::string>,
+        std::allocator<std::pair<const std::string, int>>, reclaimer_policy,
+        crh::reclamation::trace<crh::trace::ring_recorder<>>>;
+
+    std::string directory;
+
+    /**
+     * @brief Random operations of threads on keys of their own,
+     * so every outcome is known, into a trace at path
+     *
+     * @return The events each thread should have recorded
+     */
+    std::vector<std::vector<crh::trace::event>> record(map_type& map, const std::string& path,
+        const unsigned& threads, const std::size_t& ops)
+    {
+        CRH_CHECK(map.trace_recorder().open(path.c_str()));
+
+        std::vector<std::vector<crh::trace::event>> expected(threads);
+        std::vector<std::thread> workers;
+
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                std::uint64_t x = 88172645463325252ull + t;
+
+                for (std::size_t i = 0; i < ops; ++i)
+                {
+                    x ^= x << 13;
+                    x ^= x >> 7;
+                    x ^= x << 17;
+
+                    const key_type key = (x % 1000) * threads + t;
+                    crh::trace::op operation;
+                    bool succeeded;
+
+                    switch ((x >> 32) % 3)
+                    {
+                    case 0: operation = crh::trace::op::INSERT; succeeded = map.insert({key, key}, t); break;
+                    case 1: operation = crh::trace::op::ERASE; succeeded = map.erase(key, t); break;
+                    default: operation = crh::trace::op::FIND; succeeded = map.contains(key, t);
+                    }
+
+                    const std::uint8_t flags = crh::trace::S_KEY_BYTES | (succeeded ? crh::trace::S_SUCCEEDED : 0);
+                    expected[t].push_back(crh::trace::event{0, key, t, operation, flags, 0});
+                }
+            });
+        }
+
+        for (std::thread& worker : workers) worker.join();
+
+        CRH_CHECK(map.trace_recorder().close());
+        return expected;
+    }
+
+    void round_trip()
+    {
+        const std::string path = directory + "/round_trip.trace";
+        const unsigned threads = 4;
+        const std::size_t ops = 20000;
+
+        map_type map(1024, threads);
+
+        // Nothing is recorded before the trace is opened
+        for (key_type key = 0; key < 1000; ++key) map.insert({key, key}, 0);
+
+        const std::vector<std::vector<crh::trace::event>> expected = record(map, path, threads, ops);
+
+        // Nor after it is closed
+        map.insert({1u << 30, 0}, 0);
+
+        std::vector<crh::trace::event> events;
+        CRH_CHECK(crh::trace::load(path.c_str(), events));
+        CRH_CHECK(events.size() == threads * ops);
+
+        std::vector<std::size_t> position(threads, 0);
+        std::vector<std::uint64_t> last(threads, 0);
+
+        for (const crh::trace::event& e : events)
+        {
+            CRH_CHECK(e._thread_id < threads);
+            if (e._thread_id >= threads || position[e._thread_id] == ops) continue;
+
+            const crh::trace::event& wanted = expected[e._thread_id][position[e._thread_id]++];
+            CRH_CHECK(e._key == wanted._key && e._op == wanted._op && e._flags == wanted._flags);
+
+            CRH_CHECK(e._timestamp >= last[e._thread_id]);
+            last[e._thread_id] = e._timestamp;
+        }
+
+        std::remove(path.c_str());
+    }
+
+    template< class Map >
+    void replay_into(const crh::trace::schedule& s, const unsigned& threads)
+    {
+        Map map(16, threads);
+        crh::trace::replay_result result = crh::trace::replay(map, s, false);
+
+        // Each thread owns its keys, so the replay meets every outcome of the capture again
+        CRH_CHECK(result._mismatches == 0);
+        CRH_CHECK(result._latencies.size() == s._events);
+    }
+
+    void replayed()
+    {
+        const std::string path = directory + "/replayed.trace";
+        const unsigned threads = 4;
+
+        map_type map(1024, threads);
+        for (key_type key = 0; key < 1000; ++key) map.insert({key, key}, 0);
+        record(map, path, threads, 5000);
+
+        std::vector<crh::trace::event> events;
+        CRH_CHECK(crh::trace::load(path.c_str(), events));
+
+        const crh::trace::schedule s = crh::trace::make_schedule(events);
+        CRH_CHECK(s._events == threads * 5000 && s._threads.size() == threads);
+        CRH_CHECK(!s._preload.empty() && s._preload.size() <= 1000);
+
+        // Into maps configured unlike the one traced
+        replay_into<crh::concurrent_robin_map<key_type, key_type, crh::hash::hash<key_type>,
+            std::allocator<std::pair<const key_type, key_type>>, reclaimer_policy,
+            crh::reclamation::memoize_hash<true>, crh::reclamation::max_displacement<8>>>(s, threads);
+        replay_into<crh::concurrent_robin_map<key_type, key_type, crh::hash::hash<key_type>,
+            std::allocator<std::pair<const key_type, key_type>>, reclaimer_policy,
+            crh::reclamation::min_load<20>>>(s, threads);
+
+        std::remove(path.c_str());
+    }
+
+    void hashed_keys()
+    {
+        const std::string path = directory + "/hashed_keys.trace";
+
+        string_map_type map(16, 1);
+        map.insert({"a", 1}, 0);
+
+        CRH_CHECK(map.trace_recorder().open(path.c_str()));
+        map.insert({"b", 1}, 0);
+        map.contains("a", 0);
+        map.erase("c", 0);
+        CRH_CHECK(map.trace_recorder().close());
+
+        std::vector<crh::trace::event> events;
+        CRH_CHECK(crh::trace::load(path.c_str(), events));
+        CRH_CHECK(events.size() == 3);
+
+        if (events.size() == 3)
+        {
+            // Keys that do not fit the event are recorded by their hash
+            CRH_CHECK(events[0]._op == crh::trace::op::INSERT && events[0]._flags == crh::trace::S_SUCCEEDED);
+            CRH_CHECK(events[0]._key == crh::hash::hash<std::string>()("b"));
+            CRH_CHECK(events[1]._op == crh::trace::op::FIND && events[1]._flags == crh::trace::S_SUCCEEDED);
+            CRH_CHECK(events[2]._op == crh::trace::op::ERASE && events[2]._flags == 0);
+        }
+
+        std::remove(path.c_str());
+    }
+
+    void not_a_trace()
+    {
+        const std::string path = directory + "/not_a_trace.trace";
+
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        CRH_CHECK(file != nullptr);
+        if (file)
+        {
+            std::fputs("not a trace", file);
+            std::fclose(file);
+        }
+
+        std::vector<crh::trace::event> events;
+        CRH_CHECK(!crh::trace::load(path.c_str(), events));
+        CRH_CHECK(!crh::trace::load((directory + "/missing.trace").c_str(), events));
+
+        std::remove(path.c_str());
+    }
+
+    void failed_writes()
+    {
+        // Every write to /dev/full fails, where the system has one
+        std::FILE* full = std::fopen("/dev/full", "wb");
+        if (!full) return;
+        std::fclose(full);
+
+        map_type map(16, 1);
+        CRH_CHECK(map.trace_recorder().open("/dev/full"));
+
+        // Far more events than a ring holds, which must not wait on the broken file
+        for (key_type key = 0; key < 100000; ++key) map.contains(key, 0);
+
+        CRH_CHECK(!map.trace_recorder().close());
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: trace_test directory\n");
+        return EXIT_FAILURE;
+    }
+
+    directory = argv[1];
+
+    crh::test::run("round_trip", round_trip);
+    crh::test::run("replayed", replayed);
+    crh::test::run("hashed_keys", hashed_keys);
+    crh::test::run("not_a_trace", not_a_trace);
+    crh::test::run("failed_writes", failed_writes);
+
+    return crh::test::result();
+}